@@ -5,36 +5,245 @@
 #include <gmp.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 
-//function to generate prime of n-bits 
-void random_prime_bits(mpz_t result, mpz_t n) 
+#define SIEVE_LIMIT 4096				// candidates divisible by an odd prime below this are skipped without a Miller-Rabin test
+#define SIEVE_SPAN (1UL << 20)		// a random start is followed by at most this many odd candidates
+#define PRIME_PARALLEL_BITS 1024	// from this size on random_prime_bits searches on all cores
+
+static unsigned long small_primes[SIEVE_LIMIT];	// odd primes below SIEVE_LIMIT
+static int small_prime_count = 0;
+static pthread_once_t small_primes_once = PTHREAD_ONCE_INIT;
+
+//function to fill small_primes with the sieve of Eratosthenes, run once by small_primes_init
+static void small_primes_fill(void)
 {
-	mpz_t bits;
-	mpz_init(bits);
-	gmp_randstate_t state;
-	gmp_randinit_default(state);		// Initialize state with default random number generator algorithm.
-	gmp_randseed_ui(state, (rand()+1)*(rand()+1));		// Seed random number generator.
-	if (mpz_cmp_ui(n,1) <= 0) 						//  If size is less than equal to 1 
+	char composite[SIEVE_LIMIT] = {0};
+	for(unsigned long i = 3; i < SIEVE_LIMIT; i += 2)
 	{
-		printf("NO PRIME EXISTS\n");
-	} 
-	else 
+		if(!composite[i])
+		{
+			small_primes[small_prime_count++] = i;
+			for(unsigned long j = i * i; j < SIEVE_LIMIT; j += 2 * i)
+			{
+				composite[j] = 1;
+			}
+		}
+	}
+}
+
+//function to fill small_primes exactly once, the prime search threads may call it at the same time
+static void small_primes_init(void)
+{
+	pthread_once(&small_primes_once, small_primes_fill);
+}
+
+static gmp_randstate_t prime_state;	// random state of random_prime_bits, seeded once
+static int prime_state_ready = 0;
+static pthread_mutex_t prime_state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//function to seed a random state from /dev/urandom, the time and the process id are used if it cannot be read
+static void prime_state_seed(gmp_randstate_t state)
+{
+	unsigned char seed[32];
+	mpz_t s;
+	mpz_init(s);
+	FILE *f = fopen("/dev/urandom", "rb");
+	if(f != NULL && fread(seed, 1, sizeof(seed), f) == sizeof(seed))
+	{
+		mpz_import(s, sizeof(seed), 1, 1, 0, 0, seed);
+	}
+	else
+	{
+		mpz_set_ui(s, (unsigned long)time(NULL));
+		mpz_mul_2exp(s, s, 32);
+		mpz_add_ui(s, s, (unsigned long)getpid());
+	}
+	if(f != NULL)
 	{
-		mpz_t lower_limit;
-		mpz_init(lower_limit);
-		mpz_ui_pow_ui(lower_limit, 2, mpz_get_ui(n)-1);		// lower limit = 2^(n-1)
-		while (1)
+		fclose(f);
+	}
+	gmp_randseed(state, s);
+	mpz_clear(s);
+}
+
+//function to get the Miller-Rabin rounds for a random candidate of the given size, error below 2^-80 (Handbook of Applied Cryptography, table 4.4)
+int prime_rounds(unsigned long bits)
+{
+	static const unsigned long size[] = {1300, 850, 650, 550, 450, 400, 350, 300, 250, 200, 150, 100};
+	static const int rounds[] = {2, 3, 4, 5, 6, 7, 8, 9, 12, 15, 18, 27};
+	for(int i = 0; i < 12; i++)
+	{
+		if(bits >= size[i])
 		{
-			mpz_urandomb(bits, state ,mpz_get_ui(n));
-			if (mpz_cmp(bits, lower_limit) > 0 && mpz_probab_prime_p(bits,mpz_get_ui(n))) 
+			return rounds[i];
+		}
+	}
+	return 40;
+}
+
+/*
+	function to search one n-bit prime starting at a random odd number with the top bit set.
+	The residues of the start modulo the small primes are computed once, each following candidate is checked against them
+	with one addition per prime, and only the survivors get Miller-Rabin. stop is polled so parallel searches can end early.
+	Returns 1 with the prime in result, or 0 if stop was raised.
+*/
+static int prime_search(mpz_t result, unsigned long n, gmp_randstate_t state, atomic_int *stop)
+{
+	small_primes_init();
+	int count = small_prime_count;	// the table is complete once small_primes_init returns
+	unsigned long *residue = malloc(count * sizeof(unsigned long));
+	int rounds = prime_rounds(n);
+	mpz_t c;
+	mpz_init(c);
+	int found = 0;
+	
+	while(!found && !(stop != NULL && atomic_load(stop)))
+	{
+		mpz_urandomb(c, state, n);
+		mpz_setbit(c, n - 1);		// exactly n bits
+		mpz_setbit(c, 0);			// odd
+		// small candidates could equal a small prime, they are tested directly
+		int sieve = mpz_cmp_ui(c, SIEVE_LIMIT) > 0;
+		for(int i = 0; sieve && i < count; i++)
+		{
+			residue[i] = mpz_fdiv_ui(c, small_primes[i]);
+		}
+		for(unsigned long delta = 0; delta < 2 * SIEVE_SPAN; delta += 2)
+		{
+			if(delta % 4096 == 0 && stop != NULL && atomic_load(stop))
 			{
-				mpz_set(result,bits);	// Break when the generated number is prime and greater than 2^(n-1)
 				break;
 			}
-		}			
+			int divisible = 0;
+			for(int i = 0; sieve && i < count && !divisible; i++)
+			{
+				divisible = (residue[i] + delta) % small_primes[i] == 0;
+			}
+			if(divisible)
+			{
+				continue;
+			}
+			mpz_add_ui(result, c, delta);
+			if(mpz_sizeinbase(result, 2) != n)
+			{
+				break;		// walked past 2^n, a new start is drawn
+			}
+			if(mpz_probab_prime_p(result, rounds))
+			{
+				found = 1;
+				break;
+			}
+		}
+	}
+	mpz_clear(c);
+	free(residue);
+	return found;
+}
+
+/*
+	struct prime_job is the state shared by the threads of random_prime_bits_parallel.
+	Every thread searches from its own random start, the first prime found wins.
+*/
+typedef struct prime_job
+{
+	unsigned long n;
+	atomic_int stop;
+	pthread_mutex_t lock;
+	mpz_t result;
+}prime_job;
+
+//function run by each thread of random_prime_bits_parallel
+static void *prime_worker(void *arg)
+{
+	prime_job *job = arg;
+	gmp_randstate_t state;
+	mpz_t seed, p;
+	gmp_randinit_default(state);
+	mpz_init(seed);
+	mpz_init(p);
+	
+	// each thread gets its own state seeded from the shared one
+	pthread_mutex_lock(&prime_state_lock);
+	mpz_urandomb(seed, prime_state, 256);
+	pthread_mutex_unlock(&prime_state_lock);
+	gmp_randseed(state, seed);
+	
+	if(prime_search(p, job->n, state, &job->stop))
+	{
+		pthread_mutex_lock(&job->lock);
+		if(!atomic_load(&job->stop))
+		{
+			mpz_set(job->result, p);
+			atomic_store(&job->stop, 1);
+		}
+		pthread_mutex_unlock(&job->lock);
+	}
+	mpz_clear(p);
+	mpz_clear(seed);
+	gmp_randclear(state);
+	return NULL;
+}
+
+//function to initialize the random state of random_prime_bits on first use
+static void prime_state_init(void)
+{
+	pthread_mutex_lock(&prime_state_lock);
+	if(!prime_state_ready)
+	{
+		gmp_randinit_default(prime_state);
+		prime_state_seed(prime_state);
+		prime_state_ready = 1;
 	}
+	pthread_mutex_unlock(&prime_state_lock);
+}
 
+//function to generate prime of n-bits with threads searching from independent starts, threads <= 1 searches on the calling thread
+void random_prime_bits_parallel(mpz_t result, unsigned long n, int threads)
+{
+	prime_state_init();
+	if(threads <= 1)
+	{
+		pthread_mutex_lock(&prime_state_lock);
+		prime_search(result, n, prime_state, NULL);
+		pthread_mutex_unlock(&prime_state_lock);
+		return;
+	}
+	
+	prime_job job;
+	job.n = n;
+	atomic_init(&job.stop, 0);
+	pthread_mutex_init(&job.lock, NULL);
+	mpz_init(job.result);
+	pthread_t *tid = malloc(threads * sizeof(pthread_t));
+	for(int i = 0; i < threads; i++)
+	{
+		pthread_create(&tid[i], NULL, prime_worker, &job);
+	}
+	for(int i = 0; i < threads; i++)
+	{
+		pthread_join(tid[i], NULL);
+	}
+	mpz_set(result, job.result);
+	free(tid);
+	mpz_clear(job.result);
+	pthread_mutex_destroy(&job.lock);
+}
+
+//function to generate prime of n-bits: the top bit is set, candidates are sieved by small primes and large sizes use all cores
+void random_prime_bits(mpz_t result, mpz_t n) 
+{
+	if (mpz_cmp_ui(n,1) <= 0) 						//  If size is less than equal to 1 
+	{
+		printf("NO PRIME EXISTS\n");
+		return;
+	}
+	unsigned long bits = mpz_get_ui(n);
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	random_prime_bits_parallel(result, bits, bits >= PRIME_PARALLEL_BITS && cores > 1 ? (int)cores : 1);
 }
 char* stringToBinary(char* s) 		// Converts string to binary
 {
@@ -42,24 +251,240 @@ char* stringToBinary(char* s) 		// Converts string to binary
     printf("%s\n", s); 
     size_t len = strlen(s);		
     char *binary = malloc(len*8 + 1); 
-	binary[0] = '\0';
+    if(binary == NULL) return 0;
     for(size_t i = 0; i < len; ++i) 
 	{
-        char ch = s[i];
+        unsigned char ch = s[i];
         for(int j = 7; j >= 0; --j)
 		{
-            if(ch & (1 << j)) 		//shift 1 left by j bits
-			{
-                strcat(binary,"1");
-            } else 
-			{
-                strcat(binary,"0");
-            }
+            binary[i*8 + 7 - j] = (ch & (1 << j)) ? '1' : '0';		//bit j of ch is written in place, no strcat rescans
         }
     }
+	binary[len*8] = '\0';
     
     return binary;
 }
+//=====================================group enumeration and lookup starts here=====================================
+
+/*
+	struct group_table holds every element of the cyclic group generated by g:
+	elements[i] = (i+1) g, so the last element is the identity and n is the order of g.
+*/
+typedef struct group_table
+{
+	element_t *elements;
+	size_t n;
+}group_table;
+
+//function to release a group table
+void group_table_clear(group_table *T)
+{
+	for(size_t i = 0; i < T->n; i++)
+	{
+		element_clear(T->elements[i]);
+	}
+	free(T->elements);
+	T->elements = NULL;
+	T->n = 0;
+}
+
+//function to enumerate the group generated by g with one group operation per element, returns 0 if its order is above limit
+//or if the table cannot be allocated, the table is then left empty
+int group_enumerate(group_table *T, element_t g, size_t limit)
+{
+	T->elements = NULL;
+	T->n = 0;
+	size_t capacity = 0;
+	do
+	{
+		if(T->n == limit)
+		{
+			return 0;
+		}
+		if(T->n == capacity)
+		{
+			capacity = capacity ? 2 * capacity : 64;
+			element_t *grown = realloc(T->elements, capacity * sizeof(element_t));
+			if(grown == NULL)
+			{
+				group_table_clear(T);
+				return 0;
+			}
+			T->elements = grown;
+		}
+		element_init_same_as(T->elements[T->n], g);
+		if(T->n == 0)
+		{
+			element_set(T->elements[0], g);
+		}
+		else
+		{
+			element_mul(T->elements[T->n], T->elements[T->n - 1], g);	// (i+1) g = i g + g
+		}
+		T->n++;
+	}while(!element_is0(T->elements[T->n - 1]));		// until we again encounter the identity
+	return 1;
+}
+
+/*
+	struct bsgs_table holds the baby steps j g (j = 1..m) of the generator g of a group of order n, m = ceil(sqrt(n)).
+	Each record is the length of a serialized point, the serialized point and j, the records are sorted so a point is found with a binary search.
+	The length is in every record because qsort and bsearch give the comparison no context, so tables of several groups can be used at once.
+*/
+typedef struct bsgs_table
+{
+	unsigned char *records;
+	size_t m;
+	size_t key_len;			// length of a serialized point
+	size_t record_len;		// key_len + 2 sizeof(size_t)
+	element_t giant;		// -m g
+	mpz_t n;
+}bsgs_table;
+
+//function to compare two bsgs records by their point, both start with the same point length
+static int bsgs_compare(const void *a, const void *b)
+{
+	size_t key_len;
+	memcpy(&key_len, a, sizeof(size_t));
+	return memcmp((const unsigned char *)a + sizeof(size_t), (const unsigned char *)b + sizeof(size_t), key_len);
+}
+
+//function to build the baby steps of g, n is the order of g
+void bsgs_init(bsgs_table *B, element_t g, mpz_t n)
+{
+	mpz_t m;
+	mpz_init(m);
+	mpz_sqrt(m, n);
+	if(mpz_cmp_ui(m, 0) == 0 || mpz_perfect_square_p(n) == 0)
+	{
+		mpz_add_ui(m, m, 1);	// ceil(sqrt(n))
+	}
+	B->m = mpz_get_ui(m);
+	mpz_init_set(B->n, n);
+	B->key_len = element_length_in_bytes(g);
+	B->record_len = sizeof(size_t) + B->key_len + sizeof(size_t);
+	B->records = malloc(B->m * B->record_len);
+	
+	element_t step;
+	element_init_same_as(step, g);
+	element_set(step, g);
+	for(size_t j = 1; j <= B->m; j++)
+	{
+		unsigned char *r = B->records + (j - 1) * B->record_len;
+		memcpy(r, &B->key_len, sizeof(size_t));
+		element_to_bytes(r + sizeof(size_t), step);
+		memcpy(r + sizeof(size_t) + B->key_len, &j, sizeof(size_t));
+		element_mul(step, step, g);		// (j+1) g
+	}
+	qsort(B->records, B->m, B->record_len, bsgs_compare);
+	
+	element_init_same_as(B->giant, g);
+	element_pow_mpz(B->giant, g, m);
+	element_invert(B->giant, B->giant);
+	element_clear(step);
+	mpz_clear(m);
+}
+
+//function to find k in [0, n) with k g = h in O(sqrt(n)) group operations, returns 0 if h is not in the group of g
+int bsgs_log(bsgs_table *B, element_t h, mpz_t k)
+{
+	element_t gamma;
+	element_init_same_as(gamma, h);
+	element_set(gamma, h);
+	unsigned char *key = malloc(sizeof(size_t) + B->key_len);	// laid out as the start of a record
+	memcpy(key, &B->key_len, sizeof(size_t));
+	int found = 0;
+	
+	// gamma = h - i m g, a match with baby step j gives k = i m + j
+	for(size_t i = 0; i <= B->m && !found; i++)
+	{
+		if(element_is0(gamma))
+		{
+			mpz_set_ui(k, i);
+			mpz_mul_ui(k, k, B->m);
+			found = 1;
+			break;
+		}
+		element_to_bytes(key + sizeof(size_t), gamma);
+		unsigned char *r = bsearch(key, B->records, B->m, B->record_len, bsgs_compare);
+		if(r != NULL)
+		{
+			size_t j;
+			memcpy(&j, r + sizeof(size_t) + B->key_len, sizeof(size_t));
+			mpz_set_ui(k, i);
+			mpz_mul_ui(k, k, B->m);
+			mpz_add_ui(k, k, j);
+			found = 1;
+		}
+		element_mul(gamma, gamma, B->giant);
+	}
+	if(found)
+	{
+		mpz_mod(k, k, B->n);
+	}
+	free(key);
+	element_clear(gamma);
+	return found;
+}
+
+//function to release the baby steps
+void bsgs_clear(bsgs_table *B)
+{
+	free(B->records);
+	element_clear(B->giant);
+	mpz_clear(B->n);
+}
+
+//function to set P to a point of the curve with x-coordinate x, returns 0 if there is none
+int point_from_x(element_t P, mpz_t x, pairing_t pairing)
+{
+	size_t len = pairing_length_in_bytes_x_only_G1(pairing);
+	if(mpz_sizeinbase(x, 2) > 8 * len)
+	{
+		return 0;
+	}
+	unsigned char *data = calloc(len, 1);
+	size_t written = 0;
+	mpz_export(data + len - ((mpz_sizeinbase(x, 2) + 7) / 8), &written, 1, 1, 1, 0, x);	// big endian, right aligned
+	element_from_bytes_x_only(P, data);		// the point at infinity if x^3 + x is not a square
+	free(data);
+	return !element_is0(P);
+}
+
+//=====================================group enumeration and lookup ends here=====================================
+
+//function to check e(g1^a, g2^b) = e(g1, g2)^ab with one product of pairings, e(g1^a, g2^b) e(g1^-ab, g2) = 1, so the final exponentiation is shared
+int bilinearity_check(pairing_t pairing, element_t g1, element_t g2, mpz_t a, mpz_t b)
+{
+	mpz_t ab;
+	mpz_init(ab);
+	mpz_mul(ab, a, b);
+	mpz_neg(ab, ab);
+	mpz_mod(ab, ab, pairing->r);		// -ab mod r
+	
+	element_t in1[2], in2[2], out;
+	element_init_same_as(in1[0], g1);
+	element_init_same_as(in1[1], g1);
+	element_init_same_as(in2[0], g2);
+	element_init_same_as(in2[1], g2);
+	element_init_GT(out, pairing);
+	element_pow_mpz(in1[0], g1, a);
+	element_pow_mpz(in2[0], g2, b);
+	element_pow_mpz(in1[1], g1, ab);
+	element_set(in2[1], g2);
+	element_prod_pairing(out, in1, in2, 2);
+	int passed = element_is1(out);
+	
+	for(int i = 0; i < 2; i++)
+	{
+		element_clear(in1[i]);
+		element_clear(in2[i]);
+	}
+	element_clear(out);
+	mpz_clear(ab);
+	return passed;
+}
+
 void setup(mpz_t security_parameter) 
 {
 	mpz_t k; 
@@ -87,41 +512,47 @@ void setup(mpz_t security_parameter)
 	//element_random(g1);
 	element_random(g2);
 	
-	mpz_t index;
-	mpz_init(index);
-	mpz_set_ui(index, 1);		
-	element_t elements;
-	element_init_G1(elements, pairing);
-	//int j=20;
-	element_t point;
-
 	mpz_t roll_no;
 	mpz_init(roll_no);
 	mpz_set_ui(roll_no, 49);	// As roll no. was not present in the elliptic curve we take the number near to the roll no.
-	mpz_t comp;
-	mpz_init(comp);
-	//mpz_set_ui(comp, 1);
+	
+	// the group is walked once with one addition per element instead of a fresh power for every index
+	group_table T;
 	printf("\n\nElements of group are (by using generator): \n");	
-	do
+	if(!group_enumerate(&T, g2, mpz_get_ui(q) + 1))
 	{
-		element_pow_mpz(elements,g2,index);
-		gmp_printf("i = %Zd ", index);
-		element_printf("i : %B\n",elements);
-		element_init_same_as(point,element_x(elements)); //type
-		element_set(point, element_x(elements)); //value
-		// element_printf("i : %B\n",point);
-		element_to_mpz(comp, point);	
-		int ans = mpz_cmp(comp, roll_no);	//Comparing x-coordinate with the roll_no.
-		
-		if(ans==0)
-		{
-			//printf("Number near Roll number found!!\n\n");	// If found break the loop.
-			element_set(g1, elements);
-			//break;
-		}
-		mpz_add_ui(index, index, 1);
-
-	}while(!element_is0(elements));		// Do the loop until we again encounter the first element
+		printf(T.n == 0 ? "Cannot store the elements of the group\n" : "Generator does not have order q\n");
+	}
+	for(size_t i = 0; i < T.n; i++)
+	{
+		printf("i = %zu ", i + 1);
+		element_printf("i : %B\n", T.elements[i]);
+	}
+	if(mpz_cmp_ui(q, T.n) != 0)
+	{
+		printf("Group has %zu elements, expected q\n", T.n);	// the test curve is not valid
+	}
+	group_table_clear(&T);
+	
+	// the point with the roll no. as x-coordinate is found by baby-step giant-step, without a scan of the group
+	bsgs_table B;
+	bsgs_init(&B, g2, q);
+	element_t target;
+	element_init_G1(target, pairing);
+	mpz_t index;
+	mpz_init(index);
+	if(point_from_x(target, roll_no, pairing) && bsgs_log(&B, target, index))
+	{
+		gmp_printf("\nPoint with x = %Zd is i = %Zd\n", roll_no, index);
+		element_set(g1, target);
+	}
+	else
+	{
+		gmp_printf("\nNo point of the group has x = %Zd\n", roll_no);
+	}
+	element_clear(target);
+	mpz_clear(index);
+	bsgs_clear(&B);
 	
 	printf("\nPairing of number near roll no. and random element from G1:");
 	element_pairing(gt,g1,g2);
@@ -163,6 +594,7 @@ void setup(mpz_t security_parameter)
 	element_pairing(gt_new, g1_new, g2_new);
 	element_pow_mpz(gt_new, gt_new, c);
 	element_printf("\nRHS: e(g1, g2)^ab %B\n", gt_new);
+	printf("Product of pairings check: %s\n", bilinearity_check(pairing, g1_new, g2_new, a, b) ? "passed" : "failed");
 	
 	
 	//For hashing
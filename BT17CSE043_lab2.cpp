@@ -20,11 +20,35 @@ to the public keys are sku = a, sks = b, where a, b belongs to Z*q
 are randomly selected by DU and DS, respectively. Finally,
 they send the public keys PKu, PKs to CA.
 
+SPE_PP(Para, PKu, sks, w): DS executes this algorithm to
+encrypt a keyword w for DU. DS selects a random k in Z*q
+and computes r = h1(k PKs), then outputs the searchable
+ciphertext C = (U, V) where U = r PKu + r h2(w) P and
+V = e(P, P)^r.
+
+Trapdoor(Para, sku, w): DU executes this algorithm to
+generate the trapdoor Tw = (1/(sku + h2(w))) P for the
+keyword w and sends it to the cloud server.
+
+Test(Para, C, Tw): The cloud server checks whether
+e(Tw, U) = V holds. If it holds, C contains the keyword
+of the trapdoor and the algorithm outputs 1, otherwise 0.
+Since Tw is fixed for a whole search, the Miller loop of
+e(Tw, .) is precomputed once and reused for every C.
+
+The scheme also runs on an asymmetric pairing
+e : G1 x G2 -> GT (curves of type d and f). Then Q is a
+generator of G2, PKu = a Q and U = r PKu + r h2(w) Q lie
+in G2 and V = e(P, Q)^r, while Tw, PKs, h1, h2 and Test
+stay as they are. On a symmetric pairing Q = P.
+
 */
 
 #include <cstring>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <stdint.h>
 #include <iostream>
 #include <pbc/pbc.h>
 #include <stdio.h>
@@ -34,10 +58,35 @@ they send the public keys PKu, PKs to CA.
 #include <time.h>
 #include <assert.h>
 #include <bits/stdc++.h>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 
-# define MAX 100000000
 using namespace std;
 
+# define VERBOSE_QUIET 0	//only results and errors are printed
+# define VERBOSE_NORMAL 1	//also the banners of the algorithms and short summaries
+# define VERBOSE_ALL 2		//also the curve parameters and every public element
+
+int verbosity = VERBOSE_NORMAL;	//level of the demo and CLI output, set by -q and -v; the scheme functions themselves never print
+bool show_secrets = false;		//the secret keys are only printed with --show-secrets
+
 /*
 	struct setup_output is a structure.
 	The data type of each variable is explained here. Use of each variable is explained later.
@@ -54,335 +103,5412 @@ typedef struct setup_output
     pbc_param_t par;
     
     //elements of an algebraic structure
-    element_t g1,g2,gt;	//elements of group G1, G1 and GT
+    element_t g1,g2,gt;	//elements of group G1, G2 and GT
     element_t P;    // Generator of group G1
+    element_t Q;    // Generator of group G2, Q = P when the pairing is symmetric
+    element_t ePP;	// e(P,Q) element of group GT, base of V in SPE_PP
+    element_pp_t P_pp;	// fixed-base table of P, used for every multiple of P
+    element_pp_t Q_pp;	// fixed-base table of Q, used for every multiple of Q
+    
+    int initialized;	// SETUP_* flags of the members above that are initialized, setup_clear releases only these
 
 }setup_result;
 
+# define SETUP_PARAM 1		//par is initialized
+# define SETUP_PAIRING 2	//pairing and q are initialized
+# define SETUP_GENERATOR 4	//P, Q, P_pp, Q_pp and ePP are initialized
+# define SETUP_DEMO 8		//g1, g2 and gt are initialized
+
 /*
 	struct Keys is a structure.
 	The data type of each variable is explained here. Use of each variable is explained later.
 */
 typedef struct Keys 
 {
-    element_t PKu,PKs;	//PKu is the public key of data user of type element_t and PKs is the public key of data sender of type element_t
+    element_t PKu,PKs;	//PKu is the public key of data user of type element_t (in G2) and PKs is the public key of data sender of type element_t (in G1)
     mpz_t SKu, SKs;		//SKu is the public key of data user of type mpz and SKs is the public key of data sender of type mpz
+    element_pp_t PKu_pp, PKs_pp;	//fixed-base tables of PKu and PKs, used for every multiple of them in SPE_PP
+    
+    int initialized;	//1 once all members above are initialized, keys_clear releases them only then
 
 }keys;
 
-setup_result globle_setup;	//The global_setup is a variable of (type - setup_output) that holds values of the variables set by setup function to be used by other functions.
+/*
+	struct Ciphertext is a structure.
+	It holds the searchable ciphertext C = (U, V) of one keyword produced by SPE_PP.
+*/
+typedef struct Ciphertext
+{
+    element_t U;	//U = r PKu + r h2(w) Q, element of group G2
+    element_t V;	//V = e(P,Q)^r, element of group GT
+
+}ciphertext;
+
+/*
+	struct Trapdoor_output is a structure.
+	It holds the trapdoor of one keyword produced by Trapdoor.
+*/
+typedef struct Trapdoor_output
+{
+    element_t T;	//T = (1/(SKu + h2(w))) P, element of group G1
+
+}trapdoor;
 
-keys MyKeys;	//The MyKeys is a variable of (type - Keys) that holds values of the public and private keys to be used by other functions.
+/*
+	struct Keyword_arena is a structure.
+	It holds a list of canonical keywords back to back in one buffer, so encoding a keyword list
+	costs one allocation instead of one string per keyword.
+*/
+typedef struct Keyword_arena
+{
+    string bytes;			//canonical keywords stored back to back
+    vector<size_t> offset;	//keyword i is bytes[offset[i], offset[i+1]), offset has one entry more than there are keywords
 
+}keyword_arena;
 
-//function to convert a string to binary string 
-string strToBinary(string s)
+/*
+	struct Ingest_batch is a structure.
+	It carries a bounded group of documents through the stages of the ingestion pipeline.
+*/
+typedef struct Ingest_batch
 {
-    int n = s.length();	//get length of string
-  
-    string result="";
-    for (int i = 0; i <= n; i++)
-    {
-        // convert each char to ASCII value
-        int val = int(s[i]);
-  		// Convert ASCII value to binary
-        string bin = "";
-        while (val > 0)
-        {
-        	//if value is odd pust 1 in bin else push 0
-            (val % 2)? bin.push_back('1') : bin.push_back('0');
-            val /= 2;
-        }
-        reverse(bin.begin(), bin.end());
-        result+=bin;	//append the result to bin
+    vector<string> ids;		//document ids
+    keyword_arena words;	//keywords of all documents of the batch
+    vector<size_t> first;	//keywords of document i are first[i] to first[i+1]-1 of words
+    mpz_t *h2;				//h2 of every keyword, computed by the hash stage
+    size_t h2_size;			//number of initialized entries of h2
+    vector<uint32_t> tag;	//bucket tag of every keyword, computed by the hash stage when tags are on
+    vector<unsigned char> out;	//serialized documents, written by the write stage
+
+}ingest_batch;
+
+/*
+	struct Batch_queue is a structure.
+	It is a bounded queue of batches between two stages of the ingestion pipeline.
+*/
+typedef struct Batch_queue
+{
+    deque<ingest_batch *> items;
+    size_t capacity;			//push blocks while the queue holds this many batches
+    bool closed;				//no more batches will be pushed
+    mutex lock;
+    condition_variable changed;
+
+}batch_queue;
+
+# define INGEST_BATCH_DOCS 512		//maximum number of documents in one batch
+# define INGEST_BATCH_WORDS 8192	//a batch is closed once it holds this many keywords
+# define INGEST_DEPTH 4				//number of batches in flight, bounds the memory of the pipeline
+# define STREAM_MAGIC "SPECT002"	//magic of the ciphertext stream written by the ingestion pipeline
+# define STREAM_HEADER 16			//magic, length of one ciphertext and bits of the keyword tags
+# define TAG_MAX_BITS 16			//upper bound on the bits of a keyword tag, the index holds 2^bits + 1 bucket offsets
+
+/*
+	struct Test_engine is a structure.
+	It holds the state used to test many ciphertexts against one trapdoor.
+*/
+typedef struct Test_engine
+{
+    pairing_pp_t own;	//precomputed Miller loop of e(T, .) for the fixed trapdoor T, unused when it is borrowed
+    pairing_pp_ptr pp;	//precomputation used by Test, own or borrowed from the trapdoor cache
+    element_t lhs;		//scratch element of group GT that receives e(T, U)
+    vector<unsigned char> bytes;	//scratch encoding of lhs, compared with a stored V
+
+}test_engine;
+
+# define TEST_BATCH 1024	//number of ciphertexts processed per batch by Test_search
+
+/*
+	struct Trapdoor_entry is a structure.
+	It holds everything a search needs for one keyword, so a repeated query skips Trapdoor and the pairing precomputation.
+	Entries are shared read-only between the threads that look the keyword up and are released by the last one.
+*/
+typedef struct Trapdoor_entry
+{
+    trapdoor Tw;					//trapdoor of the keyword
+    vector<unsigned char> bytes;	//Tw.T serialized, what is sent to the search executor
+    bool has_pp;					//whether pp holds the precomputed Miller loop of e(T, .)
+    pairing_pp_t pp;
+
+}trapdoor_entry;
+
+/*
+	struct Trapdoor_cache is a structure.
+	It is a bounded LRU cache of the trapdoors of one data user, keyed on the SHA-256 digest of the canonical keyword.
+	All functions on it can be called from several threads at once.
+*/
+typedef struct Trapdoor_cache
+{
+    setup_result *Para;		//scheme and keys the trapdoors are computed for
+    keys *K;
+    size_t capacity;		//maximum number of entries
+    bool precompute;		//whether entries also hold the pairing precomputation
+    
+    mutex lock;
+    list<pair<string, shared_ptr<trapdoor_entry>>> lru;	//entries, the most recently used first
+    unordered_map<string, list<pair<string, shared_ptr<trapdoor_entry>>>::iterator> map;	//digest -> position in lru
+    uint64_t hits, misses, evictions;
+
+}trapdoor_cache;
+
+# define TRAPDOOR_CACHE 1024	//default number of trapdoors kept by a trapdoor cache
+# define TRAPDOOR_BATCH 256		//keywords per batch inversion of lab2 trapdoors
+
+/*
+	struct Ciphertext_store is a structure.
+	It holds a corpus of ciphertexts as fixed-width records (U bytes followed by V bytes) so that
+	any thread can decode them into elements of its own pairing.
+*/
+typedef struct Ciphertext_store
+{
+    vector<unsigned char> data;	//count records of record_len bytes each
+    size_t record_len;			//length of one serialized ciphertext
+    size_t u_len;				//length of the encoding of U at the start of every record
+    size_t count;				//number of ciphertexts in the store
+
+}ciphertext_store;
+
+/*
+	struct Ciphertext_view is a structure.
+	It describes where the encodings of U and V of count ciphertexts lie in memory, either interleaved
+	in the records of a ciphertext store or in the columns of a mapped index. Nothing is copied.
+*/
+typedef struct Ciphertext_view
+{
+    const unsigned char *U, *V;	//encodings of the first U and V
+    size_t u_stride, v_stride;	//distance in bytes between the encodings of two consecutive ciphertexts
+    size_t count;				//number of ciphertexts
+    bool compressed;			//U is stored with element_to_bytes_compressed
+    bool digest_v;				//V is stored as the first V_DIGEST_LEN bytes of the SHA-256 digest of its encoding
+
+}ciphertext_view;
+
+/*
+	struct Ciphertext_index is a structure.
+	It is an index file mapped into memory by index_open. The file is laid out as
+
+	  header   INDEX_HEADER bytes: magic, version, flags, counts, element lengths and section offsets
+	  params   pairing parameters in PBC text form
+	  U        column of count encodings of U (compressed if INDEX_COMPRESSED_U is set)
+	  V        column of count encodings of V (digests of V_DIGEST_LEN bytes if INDEX_COMPACT_V is set)
+	  doc      column of count 32 bit document numbers, ciphertext i belongs to document doc[i]
+	  id_off   documents+1 64 bit offsets into ids
+	  ids      document ids back to back
+	  bucket   2^tag_bits+1 64 bit ciphertext numbers, only when tag_bits > 0
+
+	With keyword tags the ciphertexts are ordered by tag, those of tag t are bucket[t] to bucket[t+1]-1,
+	so a search only runs Test on the bucket of its keyword.
+	Test only compares e(T, U) with V, so a compact index keeps a digest of V in place of the element and compares digests.
+	All integers are little endian and every section starts on a 64 byte boundary.
+*/
+typedef struct Ciphertext_index
+{
+    unsigned char *map;		//mapping of the whole file
+    size_t map_len;			//length of the mapping
+    uint32_t version;		//format version of the file
+    uint32_t flags;			//INDEX_* flags
+    uint64_t documents;		//number of documents
+    string params;			//pairing parameters of the ciphertexts
+    ciphertext_view view;	//columns U and V
+    const unsigned char *doc;		//column doc
+    const unsigned char *id_off;	//offsets of the document ids
+    const unsigned char *ids;		//document ids
+    uint32_t tag_bits;				//bits of the keyword tags, 0 if the ciphertexts are not bucketed
+    const unsigned char *bucket;	//offsets of the buckets
+
+}ciphertext_index;
+
+# define INDEX_MAGIC "SPEIDX\0\0"	//magic of the index file
+# define INDEX_VERSION 3			//current version of the index format, version 1 has no buckets, version 2 no compact V
+# define INDEX_HEADER 128			//length of the header, the unused part is zero
+# define INDEX_ALIGN 64				//alignment of the sections of the index
+# define INDEX_COMPRESSED_U 1		//flag: U is stored compressed
+# define INDEX_COMPACT_V 2			//flag: V is stored as a digest
+# define V_DIGEST_LEN 16			//bytes of the SHA-256 digest of V kept by a compact index
+
+# define SEARCH_SHARD 4096	//number of ciphertexts in one shard of the search executor
+# define SEARCH_BLOCK 64	//number of ciphertexts whose U is decoded together before they are tested against the trapdoors
+
+/*
+	struct Search_shard is a structure.
+	It is a range [begin, end) of records of a ciphertext store.
+*/
+typedef struct Search_shard
+{
+    size_t begin, end;
+
+}search_shard;
+
+/*
+	struct Search_worker is a structure.
+	Every worker thread of the search executor owns one, nothing in it is shared with other workers
+	except the shard queue, which other workers steal from under its lock.
+*/
+typedef struct Search_worker
+{
+    pairing_t pairing;	//private pairing of the worker, initialized from the parameter string
+    deque<trapdoor> Tw;	//trapdoors of the current search decoded into the private pairing, only grows, a deque never moves them
+    deque<element_s> U;	//U of the current block of SEARCH_BLOCK ciphertexts, decoded once for all trapdoors
+    deque<test_engine> te;	//Test engines of the current search, one per trapdoor
     
+    deque<search_shard> queue;	//shards of the current search, owner pops from the back, thieves from the front
+    mutex lock;					//protects queue
+    vector<vector<size_t>> matches;	//indices of the matches found by this worker, one list per trapdoor
+
+}search_worker;
+
+/*
+	struct Search_executor is a structure.
+	It runs Test over the shards of a ciphertext store on all cores.
+*/
+typedef struct Search_executor
+{
+    vector<unique_ptr<search_worker>> workers;	//workers are never moved since elements point into their pairing
+
+}search_executor;
+
+//=========================================instrumentation starts here=================================================================
+
+/*
+	Every scheme primitive is timed per thread into a counter and a histogram, unless the program is built with -DSPE_NO_STATS,
+	which removes the timers completely. Nothing is reported unless the environment asks for it:
+	  SPE_STATS=json|prom       print the statistics at exit (to SPE_STATS_FILE or stderr) and on SIGUSR1, and count PBC allocations
+	  SPE_TRACE=<file>          append one JSON line for every SPE_TRACE_SAMPLE-th (default 1000) primitive of a thread
+	Times are inclusive: SPE_PP also counts the hash1 and the scalar multiplications it runs.
+*/
+enum stat_op
+{
+    STAT_SETUP, STAT_KEYGEN, STAT_HASH1, STAT_HASH2, STAT_SPE_PP, STAT_TRAPDOOR, STAT_TEST,
+    STAT_PAIRING, STAT_PAIRING_PROD, STAT_SCALAR_MUL, STAT_GT_POW, STAT_OPS
+};
+
+static const char *stat_names[STAT_OPS] = {"setup", "keygen", "hash1", "hash2", "spe_pp", "trapdoor", "test",
+    "pairing", "pairing_prod", "scalar_mul", "gt_pow"};
+
+# define STAT_BUCKETS 40	//histogram bucket i counts durations in [2^i, 2^(i+1)) ns, the last one everything longer
+
+/*
+	struct Stat_block is a structure.
+	Each thread owns one and is the only writer, so updates need no atomic read-modify-write; readers see relaxed values.
+*/
+typedef struct Stat_block
+{
+    atomic<uint64_t> count[STAT_OPS];
+    atomic<uint64_t> total_ns[STAT_OPS];
+    atomic<uint64_t> hist[STAT_OPS][STAT_BUCKETS];
+    atomic<uint64_t> pbc_allocs, pbc_bytes;	//allocations made by PBC, counted when SPE_STATS is set
+    uint64_t events;						//primitives of this thread, drives the trace sampling
+
+}stat_block;
+
+/*
+	struct Stat_registry is a structure.
+	It holds the blocks of all threads, blocks outlive their threads so nothing is lost when a worker exits.
+*/
+typedef struct Stat_registry
+{
+    mutex lock;
+    vector<unique_ptr<stat_block>> blocks;
+    string format;			//"json", "prom" or empty when nothing is reported
+    FILE *trace;			//sampled trace, NULL when off
+    uint64_t sample;		//every sample-th primitive of a thread is traced
+
+}stat_registry;
+
+stat_registry stats;
+
+//function to get the block of the calling thread, it is created and registered on first use
+stat_block *stat_local()
+{
+    thread_local stat_block *local = NULL;
+    if(local == NULL)
+    {
+        local = new stat_block();	//value-initialized, every counter starts at zero
+        lock_guard<mutex> guard(stats.lock);
+        stats.blocks.push_back(unique_ptr<stat_block>(local));
     }
-    return result;	//return the converted binary string
+    return local;
 }
 
+//function to add v to a counter that only the calling thread writes
+static inline void stat_add(atomic<uint64_t> &c, uint64_t v)
+{
+    c.store(c.load(memory_order_relaxed) + v, memory_order_relaxed);
+}
 
-//function to generate keys and store then in global variable MyKeys
-void KeyGen()
+//function to get the current time in nanoseconds of a monotonic clock
+static inline uint64_t stat_now()
 {
-    mpz_t a,b;	//a and b are two type mpz numbers
-    //Initilizing a
-    mpz_init(a);
-    //Initilizing b
-    mpz_init(b);
-    // Setting them to random values
-    mpz_random(a,MAX);
-    mpz_random(b,MAX);
-    
-    //Printing the value of order of group
-    //gmp_printf("q = %Zd \n", globle_setup.q);
-    
-    cout<<endl<<"==============================================================="<<endl;
-    cout<<"Key Generation Algorithm"<<endl;
-    cout<<"==============================================================="<<endl<<endl;
-    //loop until we get a positive value for a and b
-    while(mpz_cmp_ui(a, 0U) < 0)
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//function to record n primitives run together that started at start and took ns nanoseconds, the histogram gets n times their mean
+void stat_record(int op, uint64_t start, uint64_t ns, uint64_t n = 1)
+{
+    if(n == 0)
     {
-        mpz_random(a,MAX);
-        mpz_mod(a, a, globle_setup.q);
+        return;
     }
-    while(mpz_cmp_ui(b, 0U) < 0)
+    stat_block *b = stat_local();
+    int bucket = 0;
+    for(uint64_t v = ns / n; v > 1 && bucket < STAT_BUCKETS - 1; v >>= 1)
     {
-        mpz_random(b,MAX);
-        mpz_mod(b, b, globle_setup.q);
+        bucket++;
     }
+    stat_add(b->count[op], n);
+    stat_add(b->total_ns[op], ns);
+    stat_add(b->hist[op][bucket], n);
     
-    //Taking mod so that they belong to Z*q and storing them in global_setup variable
-    mpz_mod(a, a, globle_setup.q);
-    mpz_mod(b, b, globle_setup.q);
-    
-    //Printing the values of a and b
-    gmp_printf("(SKu) Data user secret key: %Zd \n", a);
-    gmp_printf("(Sks) Data sender secret key: %Zd \n", b);
-    
-    //Initializing the values of MyKeys elements PKu and PKs 
-    element_init_G1(MyKeys.PKu, globle_setup.pairing);
-    element_init_G1(MyKeys.PKs, globle_setup.pairing);  
-	
-	//calculating and storing  public keys as PKu = aP and  PKs = bP where P is the generator og group G1   
-    element_mul_mpz(MyKeys.PKu, globle_setup.P, a);
-    element_mul_mpz(MyKeys.PKs, globle_setup.P, b);
-    
-    //Printing the values of Public key of data user and data sender
-    element_printf("\n(PKu) Data user public key: %B", MyKeys.PKu);
-    element_printf("\n(PKs) Data sender public key: %B\n", MyKeys.PKs);
-    
-   	//Initializing the values of MyKeys elements Sku and SKs 
-    mpz_init(MyKeys.SKu);
-    mpz_init(MyKeys.SKs);
-    
-     //Setting the values of secret keys of Data user and Data sender SKu = a and SKs = b
-    mpz_set(MyKeys.SKu, a);
-    mpz_set(MyKeys.SKs, b);
+    if(stats.trace != NULL && ++b->events % stats.sample == 0)
+    {
+        lock_guard<mutex> guard(stats.lock);
+        fprintf(stats.trace, "{\"op\":\"%s\",\"thread\":%zu,\"start_ns\":%llu,\"ns\":%llu}\n", stat_names[op],
+            hash<thread::id>()(this_thread::get_id()), (unsigned long long)start, (unsigned long long)ns);
+    }
+}
+
+/*
+	class Stat_timer times the scope it is declared in, as one primitive or as n primitives run together.
+*/
+class Stat_timer
+{
+public:
+    Stat_timer(int op, uint64_t n = 1) : op(op), n(n), start(stat_now()) {}
+    ~Stat_timer()
+    {
+        stat_record(op, start, stat_now() - start, n);
+    }
+
+private:
+    int op;
+    uint64_t n;
+    uint64_t start;
+};
+
+# ifndef SPE_NO_STATS
+# define STAT_SCOPE(op) Stat_timer stat_timer_scope(op)
+# define STAT_SCOPE_N(op, n) Stat_timer stat_timer_scope(op, n)
+# else
+# define STAT_SCOPE(op)
+# define STAT_SCOPE_N(op, n)
+# endif
+
+//function to print the sum of the blocks of all threads, as one JSON object or in the Prometheus text format
+void stats_dump(FILE *out, const string &format)
+{
+    uint64_t count[STAT_OPS] = {0}, total[STAT_OPS] = {0}, hist[STAT_OPS][STAT_BUCKETS] = {{0}}, allocs = 0, bytes = 0;
+    {
+        lock_guard<mutex> guard(stats.lock);
+        for(size_t t = 0; t < stats.blocks.size(); t++)
+        {
+            stat_block *b = stats.blocks[t].get();
+            for(int op = 0; op < STAT_OPS; op++)
+            {
+                count[op] += b->count[op].load(memory_order_relaxed);
+                total[op] += b->total_ns[op].load(memory_order_relaxed);
+                for(int i = 0; i < STAT_BUCKETS; i++)
+                {
+                    hist[op][i] += b->hist[op][i].load(memory_order_relaxed);
+                }
+            }
+            allocs += b->pbc_allocs.load(memory_order_relaxed);
+            bytes += b->pbc_bytes.load(memory_order_relaxed);
+        }
+    }
     
-    cout<<endl;
+    if(format == "prom")
+    {
+        fprintf(out, "# TYPE spe_op_seconds histogram\n");
+        for(int op = 0; op < STAT_OPS; op++)
+        {
+            uint64_t cumulative = 0;
+            for(int i = 0; i < STAT_BUCKETS - 1; i++)
+            {
+                cumulative += hist[op][i];
+                fprintf(out, "spe_op_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", stat_names[op], ldexp(1e-9, i + 1), (unsigned long long)cumulative);
+            }
+            fprintf(out, "spe_op_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", stat_names[op], (unsigned long long)count[op]);
+            fprintf(out, "spe_op_seconds_sum{op=\"%s\"} %.9f\n", stat_names[op], total[op] * 1e-9);
+            fprintf(out, "spe_op_seconds_count{op=\"%s\"} %llu\n", stat_names[op], (unsigned long long)count[op]);
+        }
+        fprintf(out, "# TYPE spe_pbc_allocations_total counter\nspe_pbc_allocations_total %llu\n", (unsigned long long)allocs);
+        fprintf(out, "# TYPE spe_pbc_allocated_bytes_total counter\nspe_pbc_allocated_bytes_total %llu\n", (unsigned long long)bytes);
+    }
+    else
+    {
+        fprintf(out, "{\"ops\":{");
+        for(int op = 0; op < STAT_OPS; op++)
+        {
+            fprintf(out, "%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"hist_log2_ns\":[", op ? "," : "", stat_names[op],
+                (unsigned long long)count[op], (unsigned long long)total[op]);
+            for(int i = 0; i < STAT_BUCKETS; i++)
+            {
+                fprintf(out, "%s%llu", i ? "," : "", (unsigned long long)hist[op][i]);
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "},\"pbc_allocs\":%llu,\"pbc_bytes\":%llu}\n", (unsigned long long)allocs, (unsigned long long)bytes);
+    }
+    fflush(out);
+}
 
+//function to print the statistics where SPE_STATS_FILE says, stderr by default
+void stats_report()
+{
+    const char *path = getenv("SPE_STATS_FILE");
+    FILE *out = path ? fopen(path, "a") : stderr;
+    if(out != NULL)
+    {
+        stats_dump(out, stats.format);
+        if(out != stderr)
+        {
+            fclose(out);
+        }
+    }
 }
 
-//Hash function h1 : G1 -> Z*q
-void hash1(element_t e,mpz_t h1_val)
+//allocation functions handed to PBC when statistics are reported, they count the calls of the calling thread
+void *stat_malloc(size_t size)
 {
-	//Declaring variable data of type char *
-    unsigned char data[100];
-    //Declaring variable s of type element_t
-    element_t s;
-    //Initializing variable s of type element_t to pairing
-    element_init_Zr(s, globle_setup.pairing);
+    stat_block *b = stat_local();
+    stat_add(b->pbc_allocs, 1);
+    stat_add(b->pbc_bytes, size);
+    return malloc(size);
+}
 
-	//storing char * form of e (element of group G1) sent using function element_to_bytes
-    element_to_bytes(data, e);
-    //Generate an element e deterministically from the len bytes stored in the buffer data  string ->element
-    element_from_hash(s,data,20);
-    //Converts e to a GMP integer z if such an operation makes sense
-    element_to_mpz(h1_val,s);
- 
+void *stat_realloc(void *ptr, size_t size)
+{
+    stat_block *b = stat_local();
+    stat_add(b->pbc_allocs, 1);
+    stat_add(b->pbc_bytes, size);
+    return realloc(ptr, size);
 }
 
-//Hash function h2 : {0,1}* -> Z*q
-void hash2(string str ,mpz_t h2_val)
+//thread that prints the statistics every time the process receives SIGUSR1
+void stats_signal_thread(sigset_t set)
 {
-    //Declaring variable s of type element_t
-    element_t s;
-     int len = str.length();
-    unsigned char result[len];
-    for(int i=0;i<len;i++)
+    int sig;
+    while(sigwait(&set, &sig) == 0)
     {
-        result[i]=str[i];
+        stats_report();
     }
-    //Initializing variable s of type element_t to pairing
-    element_init_Zr(s, globle_setup.pairing);
-   	//Generate an element e deterministically from the len bytes stored in the buffer data
-    element_from_hash(s,result,20);
-    //Converts e to a GMP integer z if such an operation makes sense
-    element_to_mpz(h2_val, s); 
-
 }
 
-void setup(mpz_t security_parameter) 
+//function to set up the instrumentation from the environment, it must run before any thread is started or PBC is used
+void stats_init()
 {
-	cout<<endl<<"==============================================================="<<endl;
-    cout<<"Setup Algorithm"<<endl;
-    cout<<"==============================================================="<<endl;
-    pairing_t pairing;	//pairings where elements belong; can initialize from sample pairing parameters bundled with PBC in the param subdirectory
-    pbc_param_t par;
-    
-    
-    //=========================================type a curve starts here=================================================================
-    mpz_t rb; 
-    mpz_init(rb);
-    
-    /*
-    	type a curve:(y^2 = x^3 + x)
-		exp2, exp1, sign1, sign0, r:
-  		r = 2^exp2 + sign1 * 2^exp1 + sign0 * 1 (Solinas prime)
-		q, h:
-  		r * h = q + 1
-  		q is a prime, h is a multiple of 12 (thus q = -1 mod 12)
-	*/
-    int rbits=mpz_get_ui(security_parameter)+1;	//Here value of rbits is set to value one more than that of security_paramenter which is the bits of order of group
-    mpz_set_ui(rb,rbits);
-    int qbits=10;	//Value of q bits is set to 10
-    pbc_param_init_a_gen(globle_setup.par,rbits,qbits);  // Initializing A type curve
-    
-	//pairing_init_pbc_param: Initialize a pairing with pairing parameters p
-    pairing_init_pbc_param(globle_setup.pairing, globle_setup.par);
-    pairing_init_pbc_param(pairing, globle_setup.par);
-    cout<<endl<<"Curve paramenters: "<<endl<<endl;
-    pbc_param_out_str(stdout, globle_setup.par);    // Printing the A type curve parameters
-    
-	
-	//writing the values to a file
-    FILE *stream;
-    stream = fopen("a_param.txt", "w+");    
-    pbc_param_out_str(stream, globle_setup.par);
-    fclose(stream);
-  
-  	//reading values from file
-    FILE *reading;
-    char buff[1024];
-
-    reading = fopen("a_param.txt", "r");
-    fscanf(reading, "%s", buff);
-    fgets(buff, 1024, (FILE*)reading);
-    fgets(buff, 1024, (FILE*)reading);
-    fgets(buff, 1024, (FILE*)reading);
-    fgets(buff, 1024, (FILE*)reading);
-    
-	char * r= buff+2;
-    mpz_init(globle_setup.q);
-    mpz_init_set_str(globle_setup.q,r,10);
+    const char *trace = getenv("SPE_TRACE");
+    const char *sample = getenv("SPE_TRACE_SAMPLE");
+    stats.trace = trace ? fopen(trace, "a") : NULL;
+    stats.sample = sample && atoll(sample) > 0 ? atoll(sample) : 1000;
     
-    //=========================================================type a curve ends here ================================================
-    
-    
-    
-    //========================================type a1 curve starts here=================================================================
-    
-    
-    /*
-    	type a1 curve: (y^2 = x^3 + x)
+    const char *format = getenv("SPE_STATS");
+    if(format == NULL)
+    {
+        return;
+    }
+    stats.format = format;
+    pbc_set_memory_functions(stat_malloc, stat_realloc, free);
+    atexit(stats_report);
     
-   	 	p, n, l:
-		p + 1 = n * l
-		p is prime, same as the q in a_param, n is the order of the group
-	*/
-	/*
-    mpz_t k; 
-	mpz_init(k);
-	mpz_set(k, security_parameter);		// storing security parameter in k var
-	mpz_t q; 
-	mpz_init(q);
-	random_prime_bits(q, k);			// Generating a random prime number of k bits
-	gmp_printf("\nOrder of group G1, GT is q: %Zd\n", q);		// printing order of elliptic curve
+    //SIGUSR1 is blocked here, every thread started later inherits the mask, so only the signal thread receives it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    thread(stats_signal_thread, set).detach();
+}
 
-	
-	pairing_t pairing; 
-	pbc_param_t par;
-	
-	pbc_param_init_a1_gen(par, q);		// Setting parameter "n",of a1 type elliptic curve 
-	
-	pairing_init_pbc_param(pairing, par);	//Initialize a pairing with pairing parameters par
-	printf("\nParameters are (p + 1 = n * l where p is prime, same as the q in a_param, n is the order of the group): \n");
-	pbc_param_out_str(stdout, par);			// Printing all parameters
-	mpz_init(globle_setup.q);
-    mpz_set(globle_setup.q,q);
-    */
-    
-    //printing the order of group
-    gmp_printf("\nOrder of group is: %Zd\n\n",globle_setup.q);
-    
-    //Declaring elements of group G1, G1 and GT
-    element_t g1, g2, gt, p;
-	
-	//element is initialized it is associated with an algebraic structure
-    element_init_G1(g1, pairing);
-    element_init_G1(g2, pairing);
-   	element_init_GT(gt, pairing);
-    
-    //Random elements are choosen to represent group as order of group is odd so every element of group is a generator
-	element_random(g1);
-    element_random(g2);
+//function to multiply by a scalar with a fixed-base table, timed as a scalar multiplication
+static inline void scalar_mul_pp(element_t out, mpz_t k, element_pp_t pp)
+{
+    STAT_SCOPE(STAT_SCALAR_MUL);
+    element_pp_pow(out, k, pp);
+}
 
-	//element is initialized it is associated with an algebraic structure
-    element_init_G1(globle_setup.g1, pairing);
-    element_init_G1(globle_setup.g2, pairing);
+//function to raise an element of GT to a power, timed as a GT exponentiation
+static inline void gt_pow(element_t out, element_t base, mpz_t k)
+{
+    STAT_SCOPE(STAT_GT_POW);
+    element_pow_mpz(out, base, k);
+}
 
-	//values asssigned to global variables
-    element_set(globle_setup.g1, g1);
-    element_set(globle_setup.g2, g2);
-    
-    //Values of g1, g2 are printed
-    element_printf("Element of G1 group g1: %B\n", g1);
-	element_printf("Element of G1 group g2: %B\n", g2);
+//=========================================instrumentation ends here=================================================================
 
-	//Computes a pairing: out = e(in1, in2), where in1, in2, out must be in the groups G1, G2, GT.
-	element_pairing(gt,g1,g2);
+//=========================================element pool starts here=================================================================
 
-	//element global_setup.gt is initialized it is associated with an algebraic structure GT
-    element_init_GT(globle_setup.gt,pairing);
-    //element global_setup.gt is set to value of gt
-    element_set(globle_setup.gt,gt);
+/*
+	GMP allocator of lab2. Inside a Gmp_scope, GMP blocks of up to 4096 bytes come from a cache of the calling thread: freed blocks
+	are kept on one list per size class and handed out again, new ones are carved from 64 KiB chunks of one reserved address range.
+	The temporaries PBC and GMP create and drop inside every Test or SPE_PP then stop reaching malloc. GMP passes the size of a
+	block when it frees it, so the class needs no header, and a block is known to be cached by its address.
+	Everything else is still malloc, realloc and free. A string GMP allocates, as gmp_asprintf does, may be a cached block and is
+	freed with gmp_free_string. Cached blocks are never returned to malloc, so a value created inside a scope stays valid after it;
+	the caches of finished threads, and the blocks freed after their thread ended, are handed to new threads, so the memory held
+	is bounded by the peak use of the busiest threads.
+*/
+# define GMP_CLASSES 9			//size classes of 16, 32, .., 4096 bytes
+# define GMP_CHUNK 65536
+# define GMP_RANGE (1ULL << 30)	//address space reserved for chunks, pages are only backed once they are touched
 
-	//values of pairing are printed
-    element_printf("Applying bilinear pairing on g1 and g2, gt: %B\n", gt);
-    
-    //Generator is choosen as random element from group g1 and global_setup.P is assigned 
-    element_init_G1(globle_setup.P,pairing);
-    element_init_G1(p, pairing);
-    element_random(p);
-    element_set(globle_setup.P,p);
-    
-    //value of selected generator is printed
-    element_printf("\nGenerator selected: %B\n", p);
-    
-    //Hashing
-    
-    //h1_val and h2_val are used to store results
-    mpz_t h1_val,h2_val;
-    //initizlizing
-    mpz_init(h1_val);
-    mpz_init(h2_val);
-    
-    //Hash 1
-    hash1(p, h1_val);	//h1 : G1 -> Z*q
-    
-    //Hash 2
-    string msg = "HelloWorld";	//msg whose hash value is to be calculated
-	string bin = strToBinary(msg);	//message converted to binary
+/*
+	struct Gmp_cache is a structure.
+	A thread owns at most one, the lists are linked through the first word of every free block.
+*/
+typedef struct Gmp_cache
+{
+    void *free_list[GMP_CLASSES];
+    unsigned char *bump;		//unused part of the current chunk
+    size_t left;
 
-    hash2(bin,h2_val);	//h2 : {0, 1}* -> Z*q
-    
-    //Values of hash are printed 
-    cout<<endl<<"Hash 1: ";
-    element_printf("Element of group G1: %B -> ", p);
-    gmp_printf("%Zd\n",h1_val);
-    
-    cout<<"Hash 2: (message) "<<msg<<endl<<bin<<" -> ";
-    cout<<" -> ";
-    gmp_printf("%Zd\n",h2_val);
-    
+}gmp_cache;
+
+/*
+	struct Gmp_depot is a structure.
+	It holds the reserved range, keeps the caches of finished threads, and takes the blocks freed by a thread that has already given its cache back
+	until the next thread takes a cache.
+*/
+typedef struct Gmp_depot
+{
+    unsigned char *base;		//reserved range, NULL when the cache is not installed
+    atomic<size_t> used;		//bytes of the range handed out as chunks
+    mutex lock;
+    vector<unique_ptr<gmp_cache>> idle;
+    gmp_cache orphans;
+
+}gmp_depot;
+
+gmp_depot gmp_caches;
+thread_local gmp_cache *gmp_local = NULL;
+thread_local int gmp_scope_depth = 0;
+thread_local bool gmp_thread_done = false;
+
+//function to get the size class of a block of size bytes, GMP_CLASSES if it is larger than the largest class
+static inline int gmp_class(size_t size)
+{
+    int c = 0;
+    while(c < GMP_CLASSES && ((size_t)16 << c) < size)
+    {
+        c++;
+    }
+    return c;
 }
 
-int main () 
+//function to check whether a block was carved from the reserved range
+static inline bool gmp_cached(void *ptr)
 {
-	// security paramater of type mpz
-    mpz_t security_parameter;
-    //Initializing security para,eter
-    mpz_init(security_parameter);
-    mpz_set_ui(security_parameter, 10);      // Setting lambda =6
-    
-    //Setup Algorithm
-	setup(security_parameter);
-    
-    //Key Generation Algorithm
-	KeyGen();
-    
+    return (unsigned char *)ptr >= gmp_caches.base && (unsigned char *)ptr < gmp_caches.base + GMP_RANGE;
+}
+
+/*
+	class Gmp_cache_owner gives the cache of a thread back to the depot when the thread ends.
+*/
+class Gmp_cache_owner
+{
+public:
+    ~Gmp_cache_owner()
+    {
+        if(gmp_local != NULL)
+        {
+            lock_guard<mutex> guard(gmp_caches.lock);
+            gmp_caches.idle.push_back(unique_ptr<gmp_cache>(gmp_local));
+        }
+        gmp_local = NULL;
+        gmp_thread_done = true;
+    }
+};
+
+//function to move the orphaned blocks of the depot to the lists of cache G, the depot lock must be held
+static void gmp_adopt_orphans(gmp_cache *G)
+{
+    for(int c = 0; c < GMP_CLASSES; c++)
+    {
+        void *block = gmp_caches.orphans.free_list[c];
+        while(block != NULL)
+        {
+            void *next = *(void **)block;
+            *(void **)block = G->free_list[c];
+            G->free_list[c] = block;
+            block = next;
+        }
+        gmp_caches.orphans.free_list[c] = NULL;
+    }
+}
+
+//function to get the cache of the calling thread, taking an idle one from the depot if there is one, together with the orphaned blocks
+gmp_cache *gmp_thread_cache()
+{
+    thread_local Gmp_cache_owner owner;
+    if(gmp_local == NULL)
+    {
+        lock_guard<mutex> guard(gmp_caches.lock);
+        if(!gmp_caches.idle.empty())
+        {
+            gmp_local = gmp_caches.idle.back().release();
+            gmp_caches.idle.pop_back();
+        }
+        else
+        {
+            gmp_local = new gmp_cache();
+        }
+        gmp_adopt_orphans(gmp_local);
+    }
+    return gmp_local;
+}
+
+//function to take a block of class c from cache G, NULL once the reserved range is used up
+static void *gmp_cache_take(gmp_cache *G, int c)
+{
+    void *block = G->free_list[c];
+    if(block != NULL)
+    {
+        G->free_list[c] = *(void **)block;
+        return block;
+    }
+    size_t need = (size_t)16 << c;
+    if(G->left < need)
+    {
+        //the rest of the old chunk is too small for this class and is left unused
+        size_t off = gmp_caches.used.fetch_add(GMP_CHUNK);
+        if(off + GMP_CHUNK > GMP_RANGE)
+        {
+            return NULL;
+        }
+        G->bump = gmp_caches.base + off;
+        G->left = GMP_CHUNK;
+    }
+    block = G->bump;
+    G->bump += need;
+    G->left -= need;
+    return block;
+}
+
+//allocation function of GMP
+void *gmp_alloc(size_t size)
+{
+    int c = gmp_class(size);
+    if(c < GMP_CLASSES && gmp_scope_depth > 0)
+    {
+        void *block = gmp_cache_take(gmp_thread_cache(), c);
+        if(block != NULL)
+        {
+            return block;
+        }
+    }
+    void *block = malloc(size);
+    if(block == NULL)
+    {
+        fprintf(stderr, "GMP: out of memory\n");
+        abort();
+    }
+    return block;
+}
+
+//free function of GMP, a cached block goes to the list of its class in the cache of the calling thread
+void gmp_free(void *ptr, size_t size)
+{
+    if(!gmp_cached(ptr))
+    {
+        free(ptr);
+        return;
+    }
+    int c = gmp_class(size);
+    if(gmp_thread_done)
+    {
+        lock_guard<mutex> guard(gmp_caches.lock);
+        *(void **)ptr = gmp_caches.orphans.free_list[c];
+        gmp_caches.orphans.free_list[c] = ptr;
+        return;
+    }
+    gmp_cache *G = gmp_thread_cache();
+    *(void **)ptr = G->free_list[c];
+    G->free_list[c] = ptr;
+}
+
+//reallocation function of GMP, a cached block is only moved when it outgrows its class
+void *gmp_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    if(!gmp_cached(ptr))
+    {
+        void *block = realloc(ptr, new_size);
+        if(block == NULL)
+        {
+            fprintf(stderr, "GMP: out of memory\n");
+            abort();
+        }
+        return block;
+    }
+    if(new_size <= ((size_t)16 << gmp_class(old_size)))
+    {
+        return ptr;
+    }
+    void *block = gmp_alloc(new_size);
+    memcpy(block, ptr, min(old_size, new_size));
+    gmp_free(ptr, old_size);
+    return block;
+}
+
+//function to free a string allocated by GMP, such as the result of gmp_asprintf, with the free function GMP uses
+void gmp_free_string(char *s)
+{
+    void (*free_func)(void *, size_t);
+    mp_get_memory_functions(NULL, NULL, &free_func);
+    free_func(s, strlen(s) + 1);
+}
+
+//function to make GMP use the allocator above, without a reserved range every block simply comes from malloc
+void gmp_arena_install()
+{
+    void *base = mmap(NULL, GMP_RANGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED)
+    {
+        return;
+    }
+    gmp_caches.base = (unsigned char *)base;
+    mp_set_memory_functions(gmp_alloc, gmp_realloc, gmp_free);
+}
+
+/*
+	class Gmp_scope serves the small GMP allocations of the calling thread from its cache while it lives, scopes may nest.
+*/
+class Gmp_scope
+{
+public:
+    Gmp_scope()
+    {
+        gmp_scope_depth++;
+    }
+    ~Gmp_scope()
+    {
+        gmp_scope_depth--;
+    }
+};
+
+enum pool_kind
+{
+    POOL_G1, POOL_G2, POOL_ZR, POOL_MPZ, POOL_KINDS
+};
+
+/*
+	struct Element_pool is a structure.
+	It holds elements of one pairing that are initialized once and handed out again and again, so SPE_PP and Test do not
+	initialize and clear their scratch elements for every keyword. A deque never moves its entries, so handed out pointers stay valid.
+	A pool belongs to one thread and must be cleared before its pairing.
+*/
+typedef struct Element_pool
+{
+    pairing_ptr pairing;
+    deque<element_s> elements[POOL_MPZ];	//G1, G2 and Zr elements
+    deque<__mpz_struct> mpz;
+    size_t used[POOL_KINDS];				//entries of every kind that are handed out
+
+}element_pool;
+
+//function to create an empty pool for pairing
+void pool_init(element_pool &pool, pairing_t pairing)
+{
+    pool.pairing = pairing;
+    for(int k = 0; k < POOL_KINDS; k++)
+    {
+        pool.used[k] = 0;
+    }
+}
+
+//function to hand out the next element of kind k (POOL_G1, POOL_G2 or POOL_ZR), it is initialized the first time only
+element_ptr pool_element(element_pool &pool, int k)
+{
+    deque<element_s> &list = pool.elements[k];
+    if(pool.used[k] == list.size())
+    {
+        list.emplace_back();
+        element_ptr e = &list.back();
+        if(k == POOL_G1)
+        {
+            element_init_G1(e, pool.pairing);
+        }
+        else if(k == POOL_G2)
+        {
+            element_init_G2(e, pool.pairing);
+        }
+        else
+        {
+            element_init_Zr(e, pool.pairing);
+        }
+    }
+    return &list[pool.used[k]++];
+}
+
+//functions to hand out the next element of G1, G2 or Zr
+element_ptr pool_G1(element_pool &pool)
+{
+    return pool_element(pool, POOL_G1);
+}
+
+element_ptr pool_G2(element_pool &pool)
+{
+    return pool_element(pool, POOL_G2);
+}
+
+element_ptr pool_Zr(element_pool &pool)
+{
+    return pool_element(pool, POOL_ZR);
+}
+
+//function to hand out the next integer, it is created with room for a product of two values of Zr so it rarely grows
+mpz_ptr pool_mpz(element_pool &pool)
+{
+    if(pool.used[POOL_MPZ] == pool.mpz.size())
+    {
+        pool.mpz.emplace_back();
+        mpz_init2(&pool.mpz.back(), 2 * mpz_sizeinbase(pool.pairing->r, 2) + 64);
+    }
+    return &pool.mpz[pool.used[POOL_MPZ]++];
+}
+
+//function to take back everything handed out, at the end of a batch; the entries stay initialized for the next one
+void pool_reset(element_pool &pool)
+{
+    for(int k = 0; k < POOL_KINDS; k++)
+    {
+        pool.used[k] = 0;
+    }
+}
+
+//function to clear every entry of a pool
+void pool_clear(element_pool &pool)
+{
+    for(int k = 0; k < POOL_MPZ; k++)
+    {
+        for(size_t i = 0; i < pool.elements[k].size(); i++)
+        {
+            element_clear(&pool.elements[k][i]);
+        }
+        pool.elements[k].clear();
+    }
+    for(size_t i = 0; i < pool.mpz.size(); i++)
+    {
+        mpz_clear(&pool.mpz[i]);
+    }
+    pool.mpz.clear();
+    pool_reset(pool);
+}
+
+/*
+	class Pool_scope takes back what was handed out from a pool during its lifetime, so a function can use the pool of its caller for scratch.
+*/
+class Pool_scope
+{
+public:
+    Pool_scope(element_pool &pool) : pool(pool)
+    {
+        memcpy(used, pool.used, sizeof(used));
+    }
+    ~Pool_scope()
+    {
+        memcpy(pool.used, used, sizeof(used));
+    }
+
+private:
+    element_pool &pool;
+    size_t used[POOL_KINDS];
+};
+
+//=========================================element pool ends here=================================================================
+
+//function to compute the fixed-base tables of the public keys in K
+void keys_precompute(keys &K)
+{
+    element_pp_init(K.PKu_pp, K.PKu);
+    element_pp_init(K.PKs_pp, K.PKs);
+}
+
+# define KEYGEN_SEED_BYTES 32	//bytes of /dev/urandom the key random state of a thread is seeded with
+
+/*
+	class Keygen_random holds the random state secret keys are drawn from, every thread has its own.
+*/
+class Keygen_random
+{
+public:
+    Keygen_random() : seeded(false) {}
+    ~Keygen_random()
+    {
+        if(seeded)
+        {
+            gmp_randclear(state);
+        }
+    }
+    
+    gmp_randstate_t state;
+    bool seeded;
+};
+
+thread_local Keygen_random keygen_tls;
+
+//function to get the key random state of the calling thread, it is seeded from /dev/urandom the first time
+__gmp_randstate_struct *keygen_state()
+{
+    if(!keygen_tls.seeded)
+    {
+        unsigned char bytes[KEYGEN_SEED_BYTES];
+        FILE *f = fopen("/dev/urandom", "rb");
+        bool filled = f != NULL && fread(bytes, 1, sizeof(bytes), f) == sizeof(bytes);
+        if(f != NULL)
+        {
+            fclose(f);
+        }
+        if(!filled)
+        {
+            random_device rd;
+            for(size_t i = 0; i < sizeof(bytes); i++)
+            {
+                bytes[i] = rd();
+            }
+        }
+        mpz_t seed;
+        mpz_init(seed);
+        mpz_import(seed, sizeof(bytes), 1, 1, 1, 0, bytes);
+        gmp_randinit_default(keygen_tls.state);
+        gmp_randseed(keygen_tls.state, seed);
+        mpz_clear(seed);
+        keygen_tls.seeded = true;
+    }
+    return keygen_tls.state;
+}
+
+//function to draw a uniform scalar k of Z*q = [1, q)
+void scalar_random(mpz_t k, mpz_t q)
+{
+    do
+    {
+        mpz_urandomm(k, keygen_state(), q);
+    }while(mpz_sgn(k) == 0);
+}
+
+//function to generate keys for the scheme Para and store them in K, nothing is printed
+void keys_generate(setup_result &Para, keys &K)
+{
+    STAT_SCOPE(STAT_KEYGEN);
+    mpz_t a,b;	//a and b are two type mpz numbers
+    //Initilizing a
+    mpz_init(a);
+    //Initilizing b
+    mpz_init(b);
+    //a and b are uniform in Z*q
+    scalar_random(a, Para.q);
+    scalar_random(b, Para.q);
+    
+    //Initializing the values of K elements PKu and PKs 
+    element_init_G2(K.PKu, Para.pairing);
+    element_init_G1(K.PKs, Para.pairing);  
+	
+	//calculating and storing  public keys as PKu = aQ and  PKs = bP where P and Q are the generators of groups G1 and G2
+    scalar_mul_pp(K.PKu, a, Para.Q_pp);
+    scalar_mul_pp(K.PKs, b, Para.P_pp);
+    
+    //PKu and PKs are fixed bases of SPE_PP, their tables are computed once here
+    keys_precompute(K);
+    
+   	//Initializing the values of K elements Sku and SKs 
+    mpz_init(K.SKu);
+    mpz_init(K.SKs);
+    
+     //Setting the values of secret keys of Data user and Data sender SKu = a and SKs = b
+    mpz_set(K.SKu, a);
+    mpz_set(K.SKs, b);
+    K.initialized = 1;
+    
+    mpz_clear(a);
+    mpz_clear(b);
+}
+
+//function to release the keys in K, nothing is done if they were never generated or loaded
+void keys_clear(keys &K)
+{
+    if(!K.initialized)
+    {
+        return;
+    }
+    element_pp_clear(K.PKu_pp);
+    element_pp_clear(K.PKs_pp);
+    element_clear(K.PKu);
+    element_clear(K.PKs);
+    mpz_clear(K.SKu);
+    mpz_clear(K.SKs);
+    K.initialized = 0;
+}
+
+//function to generate keys for the scheme Para and store then in K, they are printed as verbosity and show_secrets allow
+void KeyGen(setup_result &Para, keys &K)
+{
+    if(verbosity >= VERBOSE_NORMAL)
+    {
+        cout<<endl<<"==============================================================="<<endl;
+        cout<<"Key Generation Algorithm"<<endl;
+        cout<<"==============================================================="<<endl<<endl;
+    }
+    
+    keys_generate(Para, K);
+    
+    //Printing the values of a and b, only on request
+    if(show_secrets)
+    {
+        gmp_printf("(SKu) Data user secret key: %Zd \n", K.SKu);
+        gmp_printf("(Sks) Data sender secret key: %Zd \n", K.SKs);
+    }
+    
+    //Printing the values of Public key of data user and data sender
+    if(verbosity >= VERBOSE_ALL)
+    {
+        element_printf("\n(PKu) Data user public key: %B", K.PKu);
+        element_printf("\n(PKs) Data sender public key: %B\n", K.PKs);
+        cout<<endl;
+    }
+}
+
+//=========================================SHA-256 starts here=================================================================
+
+# define SHA256_LEN 32	//length in bytes of a SHA-256 digest
+
+//round constants of SHA-256
+static const uint32_t sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t sha256_rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+//function to process one 64 byte block of SHA-256
+static void sha256_block(uint32_t h[8], const unsigned char *block)
+{
+    uint32_t w[64];
+    for(int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[4*i] << 24 | (uint32_t)block[4*i+1] << 16 | (uint32_t)block[4*i+2] << 8 | block[4*i+3];
+    }
+    for(int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = sha256_rotr(w[i-15], 7) ^ sha256_rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = sha256_rotr(w[i-2], 17) ^ sha256_rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for(int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = k + (sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+//function to compute the SHA-256 digest of len bytes of data into digest, nothing is allocated
+void sha256(const void *data, size_t len, unsigned char digest[SHA256_LEN])
+{
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    const unsigned char *p = (const unsigned char *)data;
+    size_t left = len;
+    for(; left >= 64; left -= 64, p += 64)
+    {
+        sha256_block(h, p);
+    }
+    
+    //last block: remaining bytes, the bit 1, zeros and the length in bits
+    unsigned char block[128] = {0};
+    memcpy(block, p, left);
+    block[left] = 0x80;
+    size_t blocks = (left + 9 > 64) ? 2 : 1;
+    uint64_t bits = (uint64_t)len * 8;
+    for(int i = 0; i < 8; i++)
+    {
+        block[blocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for(size_t i = 0; i < blocks; i++)
+    {
+        sha256_block(h, block + 64 * i);
+    }
+    
+    for(int i = 0; i < 8; i++)
+    {
+        digest[4*i] = h[i] >> 24;
+        digest[4*i+1] = h[i] >> 16;
+        digest[4*i+2] = h[i] >> 8;
+        digest[4*i+3] = h[i];
+    }
+}
+
+//=========================================SHA-256 ends here=================================================================
+
+/*
+	struct Hash_scratch is a structure.
+	Every thread keeps one so that the hash functions do not allocate on every call.
+	It holds no element, so it does not depend on any pairing and one thread can hash for several schemes.
+*/
+typedef struct Hash_scratch
+{
+    vector<unsigned char> buf;	//serialized group element hashed by hash1, it only grows
+    vector<unsigned char> wide;	//expanded digest reduced mod q, it only grows
+
+}hash_scratch;
+
+thread_local hash_scratch hash_tls;	//scratch buffers of the hash functions of this thread
+
+/*
+	function to map a SHA-256 digest to Zq: the digest is expanded with SHA-256 in counter mode to 128 bits more than q has,
+	read as a big-endian integer and reduced mod q, so every value of Zq is almost equally likely.
+*/
+void digest_to_Zq(const unsigned char digest[SHA256_LEN], mpz_t q, mpz_t h_val)
+{
+    size_t len = (mpz_sizeinbase(q, 2) + 128 + 7) / 8;
+    size_t blocks = (len + SHA256_LEN - 1) / SHA256_LEN;
+    if(hash_tls.wide.size() < blocks * SHA256_LEN)
+    {
+        hash_tls.wide.resize(blocks * SHA256_LEN);
+    }
+    
+    //block i = SHA-256(i || digest), i as 4 bytes big-endian
+    unsigned char in[4 + SHA256_LEN];
+    memcpy(in + 4, digest, SHA256_LEN);
+    for(size_t i = 0; i < blocks; i++)
+    {
+        in[0] = i >> 24;
+        in[1] = i >> 16;
+        in[2] = i >> 8;
+        in[3] = i;
+        sha256(in, sizeof(in), &hash_tls.wide[i * SHA256_LEN]);
+    }
+    mpz_import(h_val, len, 1, 1, 1, 0, hash_tls.wide.data());
+    mpz_mod(h_val, h_val, q);
+}
+
+//Hash function h1 : G1 -> Z*q, all bytes of e are hashed with SHA-256 and the digest is mapped to Zq of the scheme Para
+void hash1(setup_result &Para, element_t e, mpz_t h1_val)
+{
+    STAT_SCOPE(STAT_HASH1);
+    unsigned char digest[SHA256_LEN];
+    size_t len = element_length_in_bytes(e);
+    if(hash_tls.buf.size() < len)
+    {
+        hash_tls.buf.resize(len);
+    }
+
+	//storing char * form of e (element of group G1) sent using function element_to_bytes
+    element_to_bytes(hash_tls.buf.data(), e);
+    sha256(hash_tls.buf.data(), len, digest);
+    digest_to_Zq(digest, Para.q, h1_val);
+}
+
+//Hash function h2 : {0,1}* -> Z*q, the whole input is hashed in place with SHA-256 and the digest is mapped to Zq of the scheme Para
+void hash2(setup_result &Para, string_view str ,mpz_t h2_val)
+{
+    STAT_SCOPE(STAT_HASH2);
+    unsigned char digest[SHA256_LEN];
+    sha256(str.data(), str.length(), digest);
+    digest_to_Zq(digest, Para.q, h2_val);
+}
+
+//=========================================keyword encoding starts here=================================================================
+
+//function to check for the ASCII whitespace that is trimmed from keywords
+static inline bool keyword_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+//function to get w without its surrounding whitespace
+string_view keyword_trim(string_view w)
+{
+    size_t begin = 0, end = w.length();
+    while(begin < end && keyword_space(w[begin]))
+    {
+        begin++;
+    }
+    while(end > begin && keyword_space(w[end - 1]))
+    {
+        end--;
+    }
+    return w.substr(begin, end - begin);
+}
+
+//function to write the canonical form of w into out (at least w.length() bytes): surrounding whitespace trimmed and ASCII letters lower-cased, returns its length
+size_t keyword_canonical(string_view w, char *out)
+{
+    w = keyword_trim(w);
+    for(size_t i = 0; i < w.length(); i++)
+    {
+        unsigned char c = w[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    return w.length();
+}
+
+thread_local string keyword_tls;	//canonical keyword buffer of this thread, it only grows
+
+//function to compute the SHA-256 digest of the canonical form of keyword w, h2(w) is this digest mapped to Zq
+void keyword_digest(string_view w, unsigned char digest[SHA256_LEN])
+{
+    if(keyword_tls.length() < w.length())
+    {
+        keyword_tls.resize(w.length());
+    }
+    size_t len = keyword_canonical(w, &keyword_tls[0]);
+    sha256(keyword_tls.data(), len, digest);
+}
+
+//function to compute h2 of the canonical form of keyword w, the raw bytes go straight into the hash
+void keyword_hash(setup_result &Para, string_view w, mpz_t h2_val)
+{
+    STAT_SCOPE(STAT_HASH2);
+    unsigned char digest[SHA256_LEN];
+    keyword_digest(w, digest);
+    digest_to_Zq(digest, Para.q, h2_val);
+}
+
+/*
+	function to derive the key of the keyword tags from the keys of the scheme Para, so only the data sender and the data user
+	can tag a keyword and the server only sees which ciphertexts share a tag. On a symmetric pairing it is the hash of the point
+	SKs PKu, which the data user gets as SKu PKs. On an asymmetric pairing PKu and PKs lie in different groups, so it is the hash
+	of e(P, PKu)^SKs, which the data user gets as e(PKs, Q)^SKu.
+*/
+void tag_key_derive(setup_result &Para, keys &K, unsigned char key[SHA256_LEN])
+{
+    element_t shared;
+    if(pairing_is_symmetric(Para.pairing))
+    {
+        element_init_same_as(shared, K.PKu);
+        element_mul_mpz(shared, K.PKu, K.SKs);
+    }
+    else
+    {
+        element_init_GT(shared, Para.pairing);
+        element_pairing(shared, Para.P, K.PKu);
+        element_pow_mpz(shared, shared, K.SKs);
+    }
+    vector<unsigned char> bytes(element_length_in_bytes(shared));
+    element_to_bytes(bytes.data(), shared);
+    sha256(bytes.data(), bytes.size(), key);
+    element_clear(shared);
+}
+
+//function to get the tag of a keyword from its digest: the first bits bits of SHA-256(key || digest), 0 if bits is 0
+uint32_t keyword_tag(const unsigned char key[SHA256_LEN], const unsigned char digest[SHA256_LEN], int bits)
+{
+    if(bits == 0)
+    {
+        return 0;
+    }
+    unsigned char in[2 * SHA256_LEN], out[SHA256_LEN];
+    memcpy(in, key, SHA256_LEN);
+    memcpy(in + SHA256_LEN, digest, SHA256_LEN);
+    sha256(in, sizeof(in), out);
+    uint32_t first = (uint32_t)out[0] << 24 | (uint32_t)out[1] << 16 | (uint32_t)out[2] << 8 | out[3];
+    return first >> (32 - bits);
+}
+
+//function to encode a whole keyword list into one arena, words are appended to what A already holds
+void keywords_encode(const vector<string> &words, keyword_arena &A)
+{
+    size_t total = A.bytes.length();
+    for(size_t i = 0; i < words.size(); i++)
+    {
+        total += words[i].length();
+    }
+    A.bytes.resize(total);
+    if(A.offset.empty())
+    {
+        A.offset.push_back(0);
+    }
+    A.offset.reserve(A.offset.size() + words.size());
+    
+    size_t used = A.offset.back();
+    for(size_t i = 0; i < words.size(); i++)
+    {
+        used += keyword_canonical(words[i], &A.bytes[used]);
+        A.offset.push_back(used);
+    }
+    A.bytes.resize(used);
+}
+
+//function to get the number of keywords in an arena
+size_t keywords_count(const keyword_arena &A)
+{
+    return A.offset.empty() ? 0 : A.offset.size() - 1;
+}
+
+//function to get keyword i of an arena, it is already canonical and can be passed to hash2 directly
+string_view keyword_at(const keyword_arena &A, size_t i)
+{
+    return string_view(A.bytes.data() + A.offset[i], A.offset[i + 1] - A.offset[i]);
+}
+
+//=========================================keyword encoding ends here=================================================================
+
+//function to get the textual form of pairing parameters, used to build a private pairing in another thread
+string param_to_string(pbc_param_t par)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *stream = open_memstream(&buf, &len);
+    pbc_param_out_str(stream, par);
+    fclose(stream);
+    
+    string result(buf, len);
+    free(buf);
+    return result;
+}
+
+//=========================================curve backend starts here=================================================================
+
+/*
+	struct Curve_spec is a structure.
+	It names the curve a scheme is set up on, the scheme code itself only sees the pairing built from it. The types are
+	  a   y^2 = x^3 + x over Fq with embedding degree 2, symmetric, prime group order r of rbits bits, q of qbits bits
+	  a1  the same curve with a group order n that is the product of two primes of rbits bits each, symmetric
+	  d   MNT curve of embedding degree 6 found by CM with the given discriminant and q of at most qbits bits, asymmetric
+	  f   Barreto-Naehrig curve of embedding degree 12 with r and q of rbits bits, asymmetric
+	An asymmetric pairing is the fastest at a given security level, because its groups are much smaller than those of type a.
+*/
+typedef struct Curve_spec
+{
+    string type;	//"a", "a1", "d" or "f"
+    int rbits;		//types a and f: bits of the group order r, type a1: bits of each of the two primes of the group order n
+    int qbits;		//type a: bits of the field size q, type d: upper bound on the bits of q, unused for types a1 and f
+    unsigned discriminant;	//type d: discriminant D of the CM method, unused for the others
+
+}curve_spec;
+
+# ifndef SPE_CURVE
+# define SPE_CURVE ""	//curve of new schemes when $SPE_CURVE is not set, e.g. -DSPE_CURVE='"f:160"'; empty for the sizes of the caller
+# endif
+
+/*
+	function to parse a curve written as a:<rbits>:<qbits>, a1:<bits of each prime>, d:<discriminant>:<qbits> or f:<rbits>, returns false if it is malformed.
+	Type a needs rbits >= 3 and qbits > rbits, as pbc_param_init_a_gen cannot generate smaller curves.
+*/
+bool curve_parse(const string &spec, curve_spec &c)
+{
+    int r = 0, q = 0;
+    unsigned D = 0;
+    char extra;
+    c.rbits = c.qbits = 0;
+    c.discriminant = 0;
+    if(sscanf(spec.c_str(), "a:%d:%d%c", &r, &q, &extra) == 2 && r >= 3 && q > r)
+    {
+        c.type = "a";
+        c.rbits = r;
+        c.qbits = q;
+        return true;
+    }
+    if(sscanf(spec.c_str(), "a1:%d%c", &r, &extra) == 1 && r > 1)
+    {
+        c.type = "a1";
+        c.rbits = r;
+        return true;
+    }
+    if(sscanf(spec.c_str(), "d:%u:%d%c", &D, &q, &extra) == 2 && D > 0 && q > 1)
+    {
+        c.type = "d";
+        c.discriminant = D;
+        c.qbits = q;
+        return true;
+    }
+    if(sscanf(spec.c_str(), "f:%d%c", &r, &extra) == 1 && r > 1)
+    {
+        c.type = "f";
+        c.rbits = r;
+        return true;
+    }
+    return false;
+}
+
+/*
+	function to choose the curve of a new scheme: the curve in $SPE_CURVE, else the one compiled in as SPE_CURVE,
+	else type a with rbits and qbits. Returns false if the chosen curve is malformed.
+*/
+bool curve_select(curve_spec &c, int rbits, int qbits)
+{
+    const char *spec = getenv("SPE_CURVE");
+    if(spec == NULL || *spec == 0)
+    {
+        spec = SPE_CURVE;
+    }
+    if(*spec != 0)
+    {
+        return curve_parse(spec, c);
+    }
+    c.type = "a";
+    c.rbits = rbits;
+    c.qbits = qbits;
+    c.discriminant = 0;
+    return true;
+}
+
+//function to get the file of the parameter store that caches the parameters of a curve, e.g. a_param_160_512.txt or f_param_160.txt
+string param_cache_path(const curve_spec &c)
+{
+    const char *dir = getenv("SPE_PARAM_DIR");	//directory of the parameter store, the working directory by default
+    string sizes = c.type == "a" ? to_string(c.rbits) + "_" + to_string(c.qbits)
+        : c.type == "d" ? to_string(c.discriminant) + "_" + to_string(c.qbits) : to_string(c.rbits);
+    return string(dir ? dir : ".") + "/" + c.type + "_param_" + sizes + ".txt";
+}
+
+//function to load parameters from the parameter store, the file is mapped instead of read, returns false if it is missing or invalid
+bool param_cache_load(pbc_param_t par, const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+    
+    struct stat st;
+    bool loaded = false;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map != MAP_FAILED)
+        {
+            //pbc_param_init_set_buf returns 0 on success
+            loaded = pbc_param_init_set_buf(par, (const char *)map, st.st_size) == 0;
+            munmap(map, st.st_size);
+        }
+    }
+    close(fd);
+    return loaded;
+}
+
+//function to save parameters in the parameter store, the file is written under a temporary name and renamed so readers never see half of it
+void param_cache_store(pbc_param_t par, const string &path)
+{
+    string text = param_to_string(par);
+    string tmp = path + "." + to_string(getpid());
+    
+    FILE *stream = fopen(tmp.c_str(), "w");
+    if(stream == NULL)
+    {
+        return;	//the store is only a cache, setup still works without it
+    }
+    bool written = fwrite(text.data(), 1, text.length(), stream) == text.length();
+    written = (fclose(stream) == 0) && written;
+    if(!written || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+    }
+}
+
+/*
+	struct Param_search is a structure.
+	It is shared by the threads of param_gen_a, the first thread that finds a curve publishes it and stops the others.
+*/
+typedef struct Param_search
+{
+    int rbits, qbits;
+    atomic<bool> found;
+    mutex lock;
+    string text;	//parameters in PBC text form, set by the winning thread
+
+}param_search;
+
+/*
+	function run by every thread of param_gen_a, the same search as pbc_param_init_a_gen on a private random state:
+	r = 2^exp2 + sign1 2^exp1 + sign0 is a Solinas prime of rbits bits and q = h r - 1 a prime with h a multiple of 12.
+*/
+void param_gen_a_worker(param_search &S, unsigned long seed)
+{
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, seed);
+    mpz_t r, q, h, t;
+    mpz_init(r);
+    mpz_init(q);
+    mpz_init(h);
+    mpz_init(t);
+    //h has about qbits - rbits bits so that q has about qbits bits
+    int hbits = max(S.qbits - S.rbits - 4 + 1, 3);
+    
+    while(!S.found.load(memory_order_relaxed))
+    {
+        //random Solinas prime r
+        int exp2, exp1, sign1, sign0;
+        if(gmp_urandomb_ui(state, 1))
+        {
+            exp2 = S.rbits - 1;
+            sign1 = 1;
+        }
+        else
+        {
+            exp2 = S.rbits;
+            sign1 = -1;
+        }
+        exp1 = gmp_urandomm_ui(state, exp2 - 1) + 1;
+        sign0 = gmp_urandomb_ui(state, 1) ? 1 : -1;
+        mpz_set_ui(r, 0);
+        mpz_setbit(r, exp2);
+        mpz_set_ui(t, 0);
+        mpz_setbit(t, exp1);
+        sign1 > 0 ? mpz_add(r, r, t) : mpz_sub(r, r, t);
+        sign0 > 0 ? mpz_add_ui(r, r, 1) : mpz_sub_ui(r, r, 1);
+        if(!mpz_probab_prime_p(r, 10))
+        {
+            continue;
+        }
+        
+        //a few cofactors are tried for every r, as pbc_param_init_a_gen does
+        for(int i = 0; i < 10 && !S.found.load(memory_order_relaxed); i++)
+        {
+            mpz_urandomb(h, state, hbits);
+            mpz_mul_ui(h, h, 12);
+            if(mpz_sgn(h) == 0)
+            {
+                continue;
+            }
+            mpz_mul(q, h, r);
+            mpz_sub_ui(q, q, 1);
+            if(!mpz_probab_prime_p(q, 10))
+            {
+                continue;
+            }
+            
+            lock_guard<mutex> guard(S.lock);
+            if(!S.found.load())
+            {
+                char *text = NULL;
+                gmp_asprintf(&text, "type a\nq %Zd\nh %Zd\nr %Zd\nexp2 %d\nexp1 %d\nsign1 %d\nsign0 %d\n", q, h, r, exp2, exp1, sign1, sign0);
+                S.text = text;
+                gmp_free_string(text);
+                S.found.store(true);
+            }
+            break;
+        }
+    }
+    mpz_clear(r);
+    mpz_clear(q);
+    mpz_clear(h);
+    mpz_clear(t);
+    gmp_randclear(state);
+}
+
+//function to generate type a parameters with the search for r and h spread over threads (0 for all cores)
+void param_gen_a(pbc_param_t par, int rbits, int qbits, unsigned threads)
+{
+    if(threads == 0)
+    {
+        threads = max(thread::hardware_concurrency(), 1U);
+    }
+    param_search S;
+    S.rbits = rbits;
+    S.qbits = qbits;
+    S.found = false;
+    
+    //every thread draws from its own state, seeded from the system entropy source
+    random_device entropy;
+    vector<thread> workers;
+    for(unsigned i = 1; i < threads; i++)
+    {
+        workers.emplace_back(param_gen_a_worker, ref(S), ((unsigned long)entropy() << 32) ^ entropy());
+    }
+    param_gen_a_worker(S, ((unsigned long)entropy() << 32) ^ entropy());
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    pbc_param_init_set_buf(par, S.text.data(), S.text.length());
+}
+
+//function called by pbc_cm_search_d for the curves it finds, the first one is taken
+static int param_gen_d_found(pbc_cm_ptr cm, void *par)
+{
+    pbc_param_init_d_gen((pbc_param_ptr)par, cm);
+    return 1;
+}
+
+//function to generate the parameters of curve c into par, nothing is cached; returns false if the CM search finds no type d curve
+bool param_gen(pbc_param_t par, const curve_spec &c)
+{
+    if(c.type == "a")
+    {
+        param_gen_a(par, c.rbits, c.qbits, 0);
+        return true;
+    }
+    if(c.type == "f")
+    {
+        pbc_param_init_f_gen(par, c.rbits);
+        return true;
+    }
+    if(c.type == "d")
+    {
+        return pbc_cm_search_d(param_gen_d_found, par, c.discriminant, c.qbits) != 0;
+    }
+    
+    //type a1: the group order is a product of two primes of rbits bits
+    mpz_t n, p;
+    mpz_init(n);
+    mpz_init(p);
+    mpz_set_ui(n, 1);
+    for(int i = 0; i < 2; i++)
+    {
+        pbc_mpz_randomb(p, c.rbits);
+        mpz_setbit(p, c.rbits - 1);
+        mpz_nextprime(p, p);
+        mpz_mul(n, n, p);
+    }
+    pbc_param_init_a1_gen(par, n);
+    mpz_clear(n);
+    mpz_clear(p);
+    return true;
+}
+
+/*
+	function to get the parameters of curve c from the parameter store, they are generated and stored on the first use.
+	The store is a catalog shared by every process pointed at the same directory: a process that has to generate a curve holds
+	an exclusive lock on <file>.lock meanwhile, so the others wait for it and load its curve instead of generating their own.
+	Returns false if no curve could be generated.
+*/
+bool param_store_get(pbc_param_t par, const curve_spec &c)
+{
+    string path = param_cache_path(c);
+    if(param_cache_load(par, path))
+    {
+        return true;
+    }
+    
+    int lock = open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if(lock >= 0)
+    {
+        flock(lock, LOCK_EX);
+    }
+    //another process may have published the curve while this one waited for the lock
+    bool loaded = param_cache_load(par, path);
+    if(!loaded)
+    {
+        loaded = param_gen(par, c);
+        if(loaded)
+        {
+            param_cache_store(par, path);
+        }
+    }
+    if(lock >= 0)
+    {
+        flock(lock, LOCK_UN);
+        close(lock);
+    }
+    return loaded;
+}
+
+//=========================================curve backend ends here=================================================================
+
+//function to initialize the pairing and the group order q of Para from the parameters in Para.par
+void setup_pairing(setup_result &Para)
+{
+	//pairing_init_pbc_param: Initialize a pairing with pairing parameters p
+    pairing_init_pbc_param(Para.pairing, Para.par);
+    //order of group q is the order r of the pairing
+    mpz_init_set(Para.q, Para.pairing->r);
+    Para.initialized |= SETUP_PAIRING;
+}
+
+//function to compute the values derived from the generators P and Q of Para, P and Q must be initialized
+void setup_precompute(setup_result &Para)
+{
+    //fixed-base tables of P and Q, KeyGen, SPE_PP and Trapdoor multiply them by a fresh scalar every time
+    element_pp_init(Para.P_pp, Para.P);
+    element_pp_init(Para.Q_pp, Para.Q);
+    
+    //e(P,Q) is computed once here, SPE_PP raises it to r for every ciphertext
+    element_init_GT(Para.ePP, Para.pairing);
+    {
+        STAT_SCOPE(STAT_PAIRING);
+        element_pairing(Para.ePP, Para.P, Para.Q);
+    }
+    Para.initialized |= SETUP_GENERATOR;
+}
+
+//function to choose the generators of Para, P at random in G1 and Q = P on a symmetric pairing or at random in G2, and to compute the values derived from them
+void setup_generators(setup_result &Para)
+{
+    element_init_G1(Para.P, Para.pairing);
+    element_random(Para.P);
+    element_init_G2(Para.Q, Para.pairing);
+    if(pairing_is_symmetric(Para.pairing))
+    {
+        element_set(Para.Q, Para.P);
+    }
+    else
+    {
+        element_random(Para.Q);
+    }
+    setup_precompute(Para);
+}
+
+//function to check the bilinearity of the pairing of Para with one product of pairings, e(aP, bQ) e(-ab P, Q) = 1 for random a and b
+bool pairing_self_test(setup_result &Para)
+{
+    mpz_t a, b, ab;
+    mpz_init(a);
+    mpz_init(b);
+    mpz_init(ab);
+    pbc_mpz_random(a, Para.q);
+    pbc_mpz_random(b, Para.q);
+    mpz_mul(ab, a, b);
+    mpz_neg(ab, ab);
+    mpz_mod(ab, ab, Para.q);
+    
+    //both pairings share one final exponentiation
+    element_t in1[2], in2[2], out;
+    element_init_G1(in1[0], Para.pairing);
+    element_init_G1(in1[1], Para.pairing);
+    element_init_G2(in2[0], Para.pairing);
+    element_init_G2(in2[1], Para.pairing);
+    element_init_GT(out, Para.pairing);
+    scalar_mul_pp(in1[0], a, Para.P_pp);
+    scalar_mul_pp(in2[0], b, Para.Q_pp);
+    scalar_mul_pp(in1[1], ab, Para.P_pp);
+    element_set(in2[1], Para.Q);
+    element_prod_pairing(out, in1, in2, 2);
+    bool passed = element_is1(out);
+    
+    for(int i = 0; i < 2; i++)
+    {
+        element_clear(in1[i]);
+        element_clear(in2[i]);
+    }
+    element_clear(out);
+    mpz_clear(a);
+    mpz_clear(b);
+    mpz_clear(ab);
+    return passed;
+}
+
+//function to release the pairing, q, P, Q and the precomputed values of Para, the parameters in Para.par are kept
+void setup_release_pairing(setup_result &Para)
+{
+    if(Para.initialized & SETUP_DEMO)
+    {
+        element_clear(Para.g1);
+        element_clear(Para.g2);
+        element_clear(Para.gt);
+    }
+    if(Para.initialized & SETUP_GENERATOR)
+    {
+        element_pp_clear(Para.P_pp);
+        element_pp_clear(Para.Q_pp);
+        element_clear(Para.ePP);
+        element_clear(Para.P);
+        element_clear(Para.Q);
+    }
+    if(Para.initialized & SETUP_PAIRING)
+    {
+        mpz_clear(Para.q);
+        pairing_clear(Para.pairing);
+    }
+    Para.initialized &= SETUP_PARAM;
+}
+
+//function to release everything of Para that is initialized, the parameters included
+void setup_clear(setup_result &Para)
+{
+    setup_release_pairing(Para);
+    if(Para.initialized & SETUP_PARAM)
+    {
+        pbc_param_clear(Para.par);
+    }
+    Para.initialized = 0;
+}
+
+//function to generate the pairing of curve c, random generators P and Q and the values derived from them into Para, nothing is printed; returns false if there is no such curve
+bool setup_generate(setup_result &Para, const curve_spec &c)
+{
+    if(!param_store_get(Para.par, c))  // curve of this type and size from the parameter store
+    {
+        return false;
+    }
+    Para.initialized |= SETUP_PARAM;
+    setup_pairing(Para);
+    
+    //Generators are choosen as random elements from groups G1 and G2
+    setup_generators(Para);
+    return true;
+}
+
+//Setup algorithm: generates the pairing, the generators P and Q and the values derived from them into Para, they are printed as verbosity allows; returns false if the curve cannot be set up
+bool setup(setup_result &Para, mpz_t security_parameter) 
+{
+    STAT_SCOPE(STAT_SETUP);
+    if(verbosity >= VERBOSE_NORMAL)
+    {
+        cout<<endl<<"==============================================================="<<endl;
+        cout<<"Setup Algorithm"<<endl;
+        cout<<"==============================================================="<<endl;
+    }
+    
+    
+    //=========================================type a curve starts here=================================================================
+    
+    /*
+    	type a curve:(y^2 = x^3 + x)
+		exp2, exp1, sign1, sign0, r:
+  		r = 2^exp2 + sign1 * 2^exp1 + sign0 * 1 (Solinas prime)
+		q, h:
+  		r * h = q + 1
+  		q is a prime, h is a multiple of 12 (thus q = -1 mod 12)
+	*/
+    int rbits=mpz_get_ui(security_parameter)+1;	//Here value of rbits is set to value one more than that of security_paramenter which is the bits of order of group
+    int qbits=10;	//Value of q bits is set to 10
+    //the curve of $SPE_CURVE or of -DSPE_CURVE replaces this one, see the curve backend
+    curve_spec curve;
+    if(!curve_select(curve, rbits, qbits) || !setup_generate(Para, curve))
+    {
+        cerr<<"cannot set up the curve of SPE_CURVE"<<endl;
+        return false;
+    }
+    //elements below must belong to the pairing of Para, a local pairing_t would no longer exist once setup returns
+    pairing_ptr pairing = Para.pairing;
+    if(verbosity >= VERBOSE_ALL)
+    {
+        cout<<endl<<"Curve paramenters: "<<endl<<endl;
+        pbc_param_out_str(stdout, Para.par);    // Printing the curve parameters
+    }
+    
+    //=========================================================type a curve ends here ================================================
+    
+    
+    
+    //========================================other curves=================================================================
+    
+    /*
+    	type a1 curve: (y^2 = x^3 + x)
+   	 	p, n, l:
+		p + 1 = n * l
+		p is prime, same as the q in a_param, n is the order of the group
+		
+		type d curve: MNT curve of embedding degree 6, type f curve: Barreto-Naehrig curve of embedding degree 12.
+		Both give an asymmetric pairing e : G1 x G2 -> GT. All of them are chosen with SPE_CURVE, see curve_parse.
+	*/
+    
+    //printing the order of group
+    if(verbosity >= VERBOSE_NORMAL)
+    {
+        gmp_printf("\nOrder of group is: %Zd\n\n",Para.q);
+    }
+    
+    //Declaring elements of group G1, G2 and GT
+    element_t g1, g2, gt;
+	
+	//element is initialized it is associated with an algebraic structure
+    element_init_G1(g1, pairing);
+    element_init_G2(g2, pairing);
+   	element_init_GT(gt, pairing);
+    
+    //Random elements are choosen to represent group as order of group is odd so every element of group is a generator
+	element_random(g1);
+    element_random(g2);
+
+	//element is initialized it is associated with an algebraic structure
+    element_init_G1(Para.g1, pairing);
+    element_init_G2(Para.g2, pairing);
+
+	//values asssigned to the variables of Para
+    element_set(Para.g1, g1);
+    element_set(Para.g2, g2);
+
+	//Computes a pairing: out = e(in1, in2), where in1, in2, out must be in the groups G1, G2, GT.
+	element_pairing(gt,g1,g2);
+
+	//element Para.gt is initialized it is associated with an algebraic structure GT
+    element_init_GT(Para.gt,pairing);
+    //element Para.gt is set to value of gt
+    element_set(Para.gt,gt);
+    Para.initialized |= SETUP_DEMO;
+    
+    if(verbosity >= VERBOSE_ALL)
+    {
+        //Values of g1, g2, their pairing and the selected generator are printed
+        element_printf("Element of G1 group g1: %B\n", g1);
+        element_printf("Element of G2 group g2: %B\n", g2);
+        element_printf("Applying bilinear pairing on g1 and g2, gt: %B\n", gt);
+        element_printf("\nGenerator selected: %B\n", Para.P);
+        if(!pairing_is_symmetric(Para.pairing))
+        {
+            element_printf("Generator of G2 selected: %B\n", Para.Q);
+        }
+    }
+    
+    bool passed = pairing_self_test(Para);
+    if(verbosity >= VERBOSE_NORMAL || !passed)
+    {
+        cout<<"Bilinearity self-test: "<<(passed ? "passed" : "FAILED")<<endl;
+    }
+    
+    //Hashing, the examples are only computed when they are printed
+    if(verbosity >= VERBOSE_ALL)
+    {
+        //h1_val and h2_val are used to store results
+        mpz_t h1_val,h2_val;
+        //initizlizing
+        mpz_init(h1_val);
+        mpz_init(h2_val);
+        
+        //Hash 1
+        hash1(Para, Para.P, h1_val);	//h1 : G1 -> Z*q
+        
+        //Hash 2
+        string msg = "HelloWorld";	//msg whose hash value is to be calculated
+        keyword_hash(Para, msg,h2_val);	//h2 : {0, 1}* -> Z*q on the bytes of the canonical message
+        
+        //Values of hash are printed 
+        cout<<endl<<"Hash 1: ";
+        element_printf("Element of group G1: %B -> ", Para.P);
+        gmp_printf("%Zd\n",h1_val);
+        
+        cout<<"Hash 2: (message) "<<msg<<" -> ";
+        gmp_printf("%Zd\n",h2_val);
+        
+        mpz_clear(h1_val);
+        mpz_clear(h2_val);
+    }
+    
+    element_clear(g1);
+    element_clear(g2);
+    element_clear(gt);
+    return true;
+}
+
+/*
+	class SchemeContext owns one setup_result, so one process can hold several schemes with different parameters
+	and use them from different threads at the same time: every function of the scheme takes the setup_result it works on.
+	Everything that is initialized is released when the context is destroyed. A context can be moved but not copied,
+	the setup_result itself never moves because its elements point into its pairing.
+*/
+class SchemeContext
+{
+public:
+    SchemeContext() : Para(new setup_result())
+    {
+        Para->initialized = 0;
+    }
+    
+    setup_result &operator*() const
+    {
+        return *Para;
+    }
+    
+    setup_result *operator->() const
+    {
+        return Para.get();
+    }
+
+private:
+    struct release
+    {
+        void operator()(setup_result *Para) const
+        {
+            setup_clear(*Para);
+            delete Para;
+        }
+    };
+    unique_ptr<setup_result, release> Para;
+};
+
+/*
+	class KeyPair owns the keys of one scheme, they are released when it is destroyed.
+	It must be destroyed before the SchemeContext its keys belong to.
+*/
+class KeyPair
+{
+public:
+    KeyPair() : K(new keys())
+    {
+        K->initialized = 0;
+    }
+    
+    keys &operator*() const
+    {
+        return *K;
+    }
+    
+    keys *operator->() const
+    {
+        return K.get();
+    }
+
+private:
+    struct release
+    {
+        void operator()(keys *K) const
+        {
+            keys_clear(*K);
+            delete K;
+        }
+    };
+    unique_ptr<keys, release> K;
+};
+
+//function to initialize the elements of a ciphertext
+void ciphertext_init(ciphertext &C, pairing_t pairing)
+{
+    element_init_G2(C.U, pairing);
+    element_init_GT(C.V, pairing);
+}
+
+//function to clear the elements of a ciphertext
+void ciphertext_clear(ciphertext &C)
+{
+    element_clear(C.U);
+    element_clear(C.V);
+}
+
+//SPE_PP algorithm for a keyword that is already hashed, h2_val = h2(w), C must be initialized with ciphertext_init, the scratch values come from pool
+void SPE_PP_hashed(setup_result &Para, keys &K, mpz_t h2_val, ciphertext &C, element_pool &pool)
+{
+    STAT_SCOPE(STAT_SPE_PP);
+    Pool_scope scope(pool);
+    mpz_ptr r = pool_mpz(pool);		//r = h1(k PKs)
+    mpz_ptr rh = pool_mpz(pool);	//r h2(w)
+    
+    //k is a random element of Z*q and R = k PKs
+    element_ptr k = pool_Zr(pool);
+    element_ptr R = pool_G1(pool);
+    element_ptr tmp = pool_G2(pool);
+    
+    //loop until r belongs to Z*q
+    do
+    {
+        element_random(k);
+        {
+            STAT_SCOPE(STAT_SCALAR_MUL);
+            element_pp_pow_zn(R, k, K.PKs_pp);
+        }
+        hash1(Para, R, r);	//h1 : G1 -> Z*q
+    }while(mpz_sgn(r) == 0);
+    
+    //U = r PKu + (r h2(w) mod q) Q
+    mpz_mul(rh, r, h2_val);
+    mpz_mod(rh, rh, Para.q);
+    scalar_mul_pp(C.U, r, K.PKu_pp);
+    scalar_mul_pp(tmp, rh, Para.Q_pp);
+    element_add(C.U, C.U, tmp);
+    
+    //V = e(P,Q)^r
+    gt_pow(C.V, Para.ePP, r);
+}
+
+//SPE_PP algorithm: encrypts keyword w for the data user of K, C must be initialized with ciphertext_init, the scratch values come from pool
+void SPE_PP(setup_result &Para, keys &K, string_view w, ciphertext &C, element_pool &pool)
+{
+    Pool_scope scope(pool);
+    mpz_ptr h2_val = pool_mpz(pool);
+    keyword_hash(Para, w, h2_val);	//h2 : {0, 1}* -> Z*q
+    SPE_PP_hashed(Para, K, h2_val, C, pool);
+}
+
+//Trapdoor algorithm for a keyword that is already hashed, h2_val = h2(w), Tw.T is initialized here
+void Trapdoor_hashed(setup_result &Para, keys &K, mpz_t h2_val, trapdoor &Tw)
+{
+    STAT_SCOPE(STAT_TRAPDOOR);
+    mpz_t t;	//t = 1/(SKu + h2(w)) mod q
+    mpz_init(t);
+    
+    mpz_add(t, h2_val, K.SKu);
+    mpz_mod(t, t, Para.q);
+    //SKu + h2(w) = 0 happens with negligible probability, the trapdoor is then the identity and matches nothing
+    if(mpz_sgn(t) != 0)
+    {
+        mpz_invert(t, t, Para.q);
+    }
+    
+    element_init_G1(Tw.T, Para.pairing);
+    scalar_mul_pp(Tw.T, t, Para.P_pp);
+    
+    mpz_clear(t);
+}
+
+//Trapdoor algorithm: computes the trapdoor of keyword w for the data user of K, Tw.T is initialized here
+void Trapdoor(setup_result &Para, keys &K, string_view w, trapdoor &Tw)
+{
+    mpz_t h2_val;
+    mpz_init(h2_val);
+    keyword_hash(Para, w, h2_val);	//h2 : {0, 1}* -> Z*q
+    Trapdoor_hashed(Para, K, h2_val, Tw);
+    mpz_clear(h2_val);
+}
+
+/*
+	function to invert n values of Zq at once with Montgomery's trick, one inversion and 3(n - 1) multiplications:
+	the prefix products in[0] .. in[i] are built up, the last one is inverted and the inverses are peeled off from the back.
+	Zero values are skipped and give 0. out may be in, the scratch values come from pool.
+*/
+void zq_invert_batch(mpz_ptr *out, mpz_ptr *in, size_t n, mpz_t q, element_pool &pool)
+{
+    Pool_scope scope(pool);
+    vector<mpz_ptr> prefix(n);
+    mpz_ptr inv = pool_mpz(pool);
+    mpz_ptr next = pool_mpz(pool);
+    
+    mpz_set_ui(inv, 1);
+    for(size_t i = 0; i < n; i++)
+    {
+        if(mpz_sgn(in[i]) != 0)
+        {
+            mpz_mul(inv, inv, in[i]);
+            mpz_mod(inv, inv, q);
+        }
+        prefix[i] = pool_mpz(pool);
+        mpz_set(prefix[i], inv);
+    }
+    
+    //inv = 1/(in[0] .. in[n-1]), then 1/in[i] = inv (in[0] .. in[i-1]) and inv becomes 1/(in[0] .. in[i-1])
+    mpz_invert(inv, inv, q);
+    for(size_t i = n; i-- > 0;)
+    {
+        if(mpz_sgn(in[i]) == 0)
+        {
+            mpz_set_ui(out[i], 0);
+            continue;
+        }
+        mpz_mul(next, inv, in[i]);
+        mpz_mod(next, next, q);
+        if(i > 0)
+        {
+            mpz_mul(inv, inv, prefix[i - 1]);
+            mpz_mod(inv, inv, q);
+        }
+        mpz_set(out[i], inv);
+        mpz_swap(inv, next);
+    }
+}
+
+//Trapdoor algorithm for n keywords that are already hashed, h2_val[i] = h2(w_i), with one inversion in Zq for all of them; every Tw[i].T is initialized here
+void Trapdoor_hashed_batch(setup_result &Para, keys &K, mpz_ptr *h2_val, size_t n, trapdoor *Tw, element_pool &pool)
+{
+    STAT_SCOPE_N(STAT_TRAPDOOR, n);
+    Pool_scope scope(pool);
+    vector<mpz_ptr> t(n);	//t[i] = 1/(SKu + h2(w_i)) mod q
+    for(size_t i = 0; i < n; i++)
+    {
+        t[i] = pool_mpz(pool);
+        mpz_add(t[i], h2_val[i], K.SKu);
+        mpz_mod(t[i], t[i], Para.q);
+    }
+    
+    //SKu + h2(w) = 0 stays 0 as in Trapdoor_hashed, that trapdoor is the identity and matches nothing
+    zq_invert_batch(t.data(), t.data(), n, Para.q, pool);
+    
+    for(size_t i = 0; i < n; i++)
+    {
+        element_init_G1(Tw[i].T, Para.pairing);
+        scalar_mul_pp(Tw[i].T, t[i], Para.P_pp);
+    }
+}
+
+//Trapdoor algorithm for n keywords with one inversion in Zq for all of them, every Tw[i].T is initialized here
+void Trapdoor_batch(setup_result &Para, keys &K, const string *w, size_t n, trapdoor *Tw, element_pool &pool)
+{
+    Pool_scope scope(pool);
+    vector<mpz_ptr> h2_val(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        h2_val[i] = pool_mpz(pool);
+        keyword_hash(Para, w[i], h2_val[i]);	//h2 : {0, 1}* -> Z*q
+    }
+    Trapdoor_hashed_batch(Para, K, h2_val.data(), n, Tw, pool);
+}
+
+//function to prepare a test engine for trapdoor Tw, the Miller loop of e(T, .) is computed only once here
+void test_engine_init(test_engine &te, trapdoor &Tw, pairing_t pairing)
+{
+    pairing_pp_init(te.own, Tw.T, pairing);
+    te.pp = te.own;
+    element_init_GT(te.lhs, pairing);
+    te.bytes.resize(pairing_length_in_bytes_GT(pairing));
+}
+
+//function to prepare a test engine that uses a precomputation owned by someone else, pp must outlive the engine
+void test_engine_borrow(test_engine &te, pairing_pp_ptr pp, pairing_t pairing)
+{
+    te.pp = pp;
+    element_init_GT(te.lhs, pairing);
+    te.bytes.resize(pairing_length_in_bytes_GT(pairing));
+}
+
+//function to clear a test engine, a borrowed precomputation is left alone
+void test_engine_clear(test_engine &te)
+{
+    if(te.pp == te.own)
+    {
+        pairing_pp_clear(te.own);
+    }
+    element_clear(te.lhs);
+}
+
+//Test algorithm: returns 1 if e(T, U) = V i.e. C contains the keyword of the trapdoor, otherwise 0
+int Test(test_engine &te, ciphertext &C)
+{
+    STAT_SCOPE(STAT_TEST);
+    pairing_pp_apply(te.lhs, C.U, te.pp);
+    return element_cmp(te.lhs, C.V) == 0;
+}
+
+/*
+	Test algorithm on a stored V: v is the encoding of V, or with digest its first V_DIGEST_LEN digest bytes.
+	The encoding of an element of GT is canonical, so V is never decoded and the bytes of e(T, U) are compared instead.
+*/
+int Test_stored(test_engine &te, element_t U, const unsigned char *v, bool digest)
+{
+    STAT_SCOPE(STAT_TEST);
+    pairing_pp_apply(te.lhs, U, te.pp);
+    element_to_bytes(te.bytes.data(), te.lhs);
+    if(!digest)
+    {
+        return memcmp(te.bytes.data(), v, te.bytes.size()) == 0;
+    }
+    unsigned char lhs_digest[SHA256_LEN];
+    sha256(te.bytes.data(), te.bytes.size(), lhs_digest);
+    return memcmp(lhs_digest, v, V_DIGEST_LEN) == 0;
+}
+
+//function to test one batch of n ciphertexts, the index (base + i) of every match is appended to matches
+void Test_batch(test_engine &te, ciphertext *C, size_t n, size_t base, vector<size_t> &matches)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        if(Test(te, C[i]))
+        {
+            matches.push_back(base + i);
+        }
+    }
+}
+
+//function to search a store of n ciphertexts for trapdoor Tw in batches of TEST_BATCH, returns the number of matches
+size_t Test_search(trapdoor &Tw, ciphertext *C, size_t n, pairing_t pairing, vector<size_t> &matches)
+{
+    test_engine te;
+    test_engine_init(te, Tw, pairing);
+    
+    size_t found = matches.size();
+    for(size_t base = 0; base < n; base += TEST_BATCH)
+    {
+        Gmp_scope scope;
+        Test_batch(te, C + base, min((size_t)TEST_BATCH, n - base), base, matches);
+    }
+    
+    test_engine_clear(te);
+    return matches.size() - found;
+}
+
+# define VERIFY_LEAF 4	//ranges of at most this many pairs are checked pair by pair by Test_verify
+
+//function to check whether every pair of [lo, hi) matches: prod e(T_i, d_i U_i) = prod V_i^d_i, with one shared final exponentiation
+static bool verify_range(element_t *in1, element_t *in2, element_t *Vd, size_t lo, size_t hi, element_t lhs, element_t rhs)
+{
+    STAT_SCOPE(STAT_PAIRING_PROD);
+    element_prod_pairing(lhs, in1 + lo, in2 + lo, hi - lo);
+    element_set(rhs, Vd[lo]);
+    for(size_t i = lo + 1; i < hi; i++)
+    {
+        element_mul(rhs, rhs, Vd[i]);
+    }
+    return element_cmp(lhs, rhs) == 0;
+}
+
+//function to find the pairs of [lo, hi) that do not match: a range that passes as a whole is done, otherwise it is split in two
+static void verify_bisect(element_t *in1, element_t *in2, element_t *Vd, ciphertext *C, size_t lo, size_t hi, element_t lhs, element_t rhs, vector<size_t> &bad)
+{
+    if(hi - lo > VERIFY_LEAF)
+    {
+        if(verify_range(in1, in2, Vd, lo, hi, lhs, rhs))
+        {
+            return;
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        verify_bisect(in1, in2, Vd, C, lo, mid, lhs, rhs, bad);
+        verify_bisect(in1, in2, Vd, C, mid, hi, lhs, rhs, bad);
+        return;
+    }
+    //small ranges fall back to the plain Test equation
+    for(size_t i = lo; i < hi; i++)
+    {
+        STAT_SCOPE(STAT_PAIRING);
+        element_pairing(lhs, in1[i], C[i].U);
+        if(element_cmp(lhs, C[i].V) != 0)
+        {
+            bad.push_back(i);
+        }
+    }
+}
+
+/*
+	function to verify a batch of n pairs (T[i], C[i]) that are all expected to match, e.g. the matches reported by a search.
+	With random 64 bit d_i, prod e(T_i, d_i U_i) = prod V_i^d_i holds for matching pairs, and a pair that does not match
+	passes with probability about 2^-64. When all pairs match this costs one product of pairings, otherwise the batch is bisected.
+	The indices of the pairs that do not match are appended to bad, the function returns true if there are none.
+*/
+bool Test_verify(pairing_t pairing, element_ptr *T, ciphertext *C, size_t n, vector<size_t> &bad)
+{
+    if(n == 0)
+    {
+        return true;
+    }
+    element_t *in1 = (element_t *)malloc(n * sizeof(element_t));
+    element_t *in2 = (element_t *)malloc(n * sizeof(element_t));
+    element_t *Vd = (element_t *)malloc(n * sizeof(element_t));
+    element_t lhs, rhs;
+    element_init_GT(lhs, pairing);
+    element_init_GT(rhs, pairing);
+    mpz_t d;
+    mpz_init(d);
+    for(size_t i = 0; i < n; i++)
+    {
+        pbc_mpz_randomb(d, 64);
+        element_init_G1(in1[i], pairing);
+        element_init_G2(in2[i], pairing);
+        element_init_GT(Vd[i], pairing);
+        element_set(in1[i], T[i]);
+        {
+            STAT_SCOPE(STAT_SCALAR_MUL);
+            element_mul_mpz(in2[i], C[i].U, d);
+        }
+        gt_pow(Vd[i], C[i].V, d);
+    }
+    
+    size_t before = bad.size();
+    verify_bisect(in1, in2, Vd, C, 0, n, lhs, rhs, bad);
+    
+    for(size_t i = 0; i < n; i++)
+    {
+        element_clear(in1[i]);
+        element_clear(in2[i]);
+        element_clear(Vd[i]);
+    }
+    free(in1);
+    free(in2);
+    free(Vd);
+    element_clear(lhs);
+    element_clear(rhs);
+    mpz_clear(d);
+    return bad.size() == before;
+}
+
+//=========================================trapdoor cache starts here=================================================================
+
+//function to create an empty trapdoor cache for the keys K of the scheme Para, with precompute the entries also hold e(T, .) precomputed
+void trapdoor_cache_init(trapdoor_cache &tc, setup_result &Para, keys &K, size_t capacity, bool precompute)
+{
+    tc.Para = &Para;
+    tc.K = &K;
+    tc.capacity = max(capacity, (size_t)1);
+    tc.precompute = precompute;
+    tc.hits = tc.misses = tc.evictions = 0;
+}
+
+//function to release an entry once no search uses it any more
+void trapdoor_entry_release(trapdoor_entry *e)
+{
+    if(e->has_pp)
+    {
+        pairing_pp_clear(e->pp);
+    }
+    element_clear(e->Tw.T);
+    delete e;
+}
+
+/*
+	function to get the cache entry of keyword w, it is computed and inserted on a miss and the least recently used entry is evicted when the cache is full.
+	The entry stays valid as long as the returned pointer is held, even if it is evicted meanwhile.
+*/
+shared_ptr<trapdoor_entry> trapdoor_cache_get(trapdoor_cache &tc, string_view w)
+{
+    unsigned char digest[SHA256_LEN];
+    keyword_digest(w, digest);
+    string key((const char *)digest, SHA256_LEN);
+    
+    {
+        lock_guard<mutex> guard(tc.lock);
+        auto it = tc.map.find(key);
+        if(it != tc.map.end())
+        {
+            tc.lru.splice(tc.lru.begin(), tc.lru, it->second);
+            tc.hits++;
+            return it->second->second;
+        }
+        tc.misses++;
+    }
+    
+    //the trapdoor is computed without the lock, so a miss does not hold up the other threads
+    mpz_t h2_val;
+    mpz_init(h2_val);
+    digest_to_Zq(digest, tc.Para->q, h2_val);
+    shared_ptr<trapdoor_entry> e(new trapdoor_entry(), trapdoor_entry_release);
+    Trapdoor_hashed(*tc.Para, *tc.K, h2_val, e->Tw);
+    mpz_clear(h2_val);
+    e->bytes.resize(element_length_in_bytes(e->Tw.T));
+    element_to_bytes(e->bytes.data(), e->Tw.T);
+    e->has_pp = tc.precompute;
+    if(e->has_pp)
+    {
+        pairing_pp_init(e->pp, e->Tw.T, tc.Para->pairing);
+    }
+    
+    lock_guard<mutex> guard(tc.lock);
+    auto it = tc.map.find(key);
+    if(it != tc.map.end())
+    {
+        //another thread inserted the same keyword meanwhile, its entry is kept
+        tc.lru.splice(tc.lru.begin(), tc.lru, it->second);
+        return it->second->second;
+    }
+    tc.lru.emplace_front(key, e);
+    tc.map[key] = tc.lru.begin();
+    if(tc.lru.size() > tc.capacity)
+    {
+        tc.map.erase(tc.lru.back().first);
+        tc.lru.pop_back();
+        tc.evictions++;
+    }
+    return e;
+}
+
+//function to read the counters of a trapdoor cache
+void trapdoor_cache_stats(trapdoor_cache &tc, uint64_t &hits, uint64_t &misses, uint64_t &evictions)
+{
+    lock_guard<mutex> guard(tc.lock);
+    hits = tc.hits;
+    misses = tc.misses;
+    evictions = tc.evictions;
+}
+
+//function to drop every entry of a trapdoor cache, entries still held by a search are released by it
+void trapdoor_cache_clear(trapdoor_cache &tc)
+{
+    lock_guard<mutex> guard(tc.lock);
+    tc.map.clear();
+    tc.lru.clear();
+}
+
+//function to prepare a test engine for a cache entry, the precomputation of the entry is borrowed when it has one
+void test_engine_init_cached(test_engine &te, trapdoor_entry &e, pairing_t pairing)
+{
+    if(e.has_pp)
+    {
+        test_engine_borrow(te, e.pp, pairing);
+    }
+    else
+    {
+        test_engine_init(te, e.Tw, pairing);
+    }
+}
+
+//=========================================trapdoor cache ends here=================================================================
+
+//function to get the length in bytes of one serialized ciphertext
+size_t ciphertext_length(pairing_t pairing)
+{
+    return pairing_length_in_bytes_G2(pairing) + pairing_length_in_bytes_GT(pairing);
+}
+
+//function to serialize a ciphertext into ciphertext_length bytes
+void ciphertext_to_bytes(unsigned char *data, ciphertext &C)
+{
+    data += element_to_bytes(data, C.U);
+    element_to_bytes(data, C.V);
+}
+
+//function to deserialize a ciphertext, C must be initialized with ciphertext_init
+void ciphertext_from_bytes(ciphertext &C, const unsigned char *data)
+{
+    data += element_from_bytes(C.U, (unsigned char *)data);
+    element_from_bytes(C.V, (unsigned char *)data);
+}
+
+//function to decode U of ciphertext i of a view into U, an element of group G2
+void view_get_U(element_t U, const ciphertext_view &S, size_t i)
+{
+    unsigned char *u = (unsigned char *)S.U + i * S.u_stride;
+    if(S.compressed)
+    {
+        element_from_bytes_compressed(U, u);
+    }
+    else
+    {
+        element_from_bytes(U, u);
+    }
+}
+
+//function to decode ciphertext i of a view, C must be initialized with ciphertext_init and V must not be stored as a digest
+void ciphertext_from_view(ciphertext &C, const ciphertext_view &S, size_t i)
+{
+    view_get_U(C.U, S, i);
+    element_from_bytes(C.V, (unsigned char *)S.V + i * S.v_stride);
+}
+
+//function to initialize an empty ciphertext store for the given pairing
+void store_init(ciphertext_store &S, pairing_t pairing)
+{
+    S.data.clear();
+    S.record_len = ciphertext_length(pairing);
+    S.u_len = pairing_length_in_bytes_G2(pairing);
+    S.count = 0;
+}
+
+//function to append a ciphertext to the store
+void store_append(ciphertext_store &S, ciphertext &C)
+{
+    S.data.resize((S.count + 1) * S.record_len);
+    ciphertext_to_bytes(&S.data[S.count * S.record_len], C);
+    S.count++;
+}
+
+//function to get a view of the ciphertexts of a store
+ciphertext_view store_view(const ciphertext_store &S)
+{
+    ciphertext_view view;
+    view.U = S.data.data();
+    view.V = S.data.data() + S.u_len;
+    view.u_stride = view.v_stride = S.record_len;
+    view.count = S.count;
+    view.compressed = false;
+    view.digest_v = false;
+    return view;
+}
+
+//function to clear a search executor
+void executor_clear(search_executor &ex)
+{
+    for(size_t i = 0; i < ex.workers.size(); i++)
+    {
+        search_worker *w = ex.workers[i].get();
+        for(size_t t = 0; t < w->Tw.size(); t++)
+        {
+            element_clear(w->Tw[t].T);
+        }
+        for(size_t j = 0; j < w->U.size(); j++)
+        {
+            element_clear(&w->U[j]);
+        }
+        pairing_clear(w->pairing);
+    }
+    ex.workers.clear();
+}
+
+//function to create a search executor with the given number of workers, 0 means one per core, returns false if params are not valid pairing parameters
+bool executor_init(search_executor &ex, const string &params, unsigned threads)
+{
+    if(threads == 0)
+    {
+        threads = max(1U, thread::hardware_concurrency());
+    }
+    
+    for(unsigned i = 0; i < threads; i++)
+    {
+        unique_ptr<search_worker> w(new search_worker);
+        //every worker parses the parameters into its own pairing so that no pairing state is shared between threads
+        if(pairing_init_set_buf(w->pairing, params.data(), params.length()) != 0)
+        {
+            executor_clear(ex);
+            return false;
+        }
+        for(int j = 0; j < SEARCH_BLOCK; j++)
+        {
+            w->U.emplace_back();
+            element_init_G2(&w->U.back(), w->pairing);
+        }
+        ex.workers.push_back(move(w));
+    }
+    return true;
+}
+
+//function to take the next shard for worker id, first from its own queue and then by stealing from the others
+bool executor_next_shard(search_executor &ex, size_t id, search_shard &shard)
+{
+    search_worker *self = ex.workers[id].get();
+    {
+        lock_guard<mutex> guard(self->lock);
+        if(!self->queue.empty())
+        {
+            shard = self->queue.back();
+            self->queue.pop_back();
+            return true;
+        }
+    }
+    
+    //own queue is empty, steal the oldest shard of the next non-empty queue
+    size_t n = ex.workers.size();
+    for(size_t k = 1; k < n; k++)
+    {
+        search_worker *victim = ex.workers[(id + k) % n].get();
+        lock_guard<mutex> guard(victim->lock);
+        if(!victim->queue.empty())
+        {
+            shard = victim->queue.front();
+            victim->queue.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+	function run by every worker thread of the executor. U is decoded once per ciphertext, a block at a time, and the block
+	is tested against all k trapdoors. V stays in the view and is compared in its stored form.
+*/
+void executor_worker(search_executor &ex, size_t id, const ciphertext_view &S, size_t k)
+{
+    search_worker *w = ex.workers[id].get();
+    search_shard shard;
+    
+    while(executor_next_shard(ex, id, shard))
+    {
+        Gmp_scope scope;
+        for(size_t base = shard.begin; base < shard.end; base += SEARCH_BLOCK)
+        {
+            size_t n = min((size_t)SEARCH_BLOCK, shard.end - base);
+            for(size_t j = 0; j < n; j++)
+            {
+                view_get_U(&w->U[j], S, base + j);
+            }
+            for(size_t t = 0; t < k; t++)
+            {
+                for(size_t j = 0; j < n; j++)
+                {
+                    if(Test_stored(w->te[t], &w->U[j], S.V + (base + j) * S.v_stride, S.digest_v))
+                    {
+                        w->matches[t].push_back(base + j);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+	function to search the ciphertexts of a view for k serialized trapdoors at once on all workers, in one pass over the view.
+	The matches of trapdoor t are appended to matches[t] in increasing order, returns the total number of matches.
+*/
+size_t executor_search_batch(search_executor &ex, const unsigned char *const *trapdoor_bytes, size_t k, const ciphertext_view &S, vector<vector<size_t>> &matches)
+{
+    size_t n = ex.workers.size();
+    
+    //every worker decodes the trapdoors into its own pairing and precomputes its own Test engines
+    for(size_t i = 0; i < n; i++)
+    {
+        search_worker *w = ex.workers[i].get();
+        while(w->Tw.size() < k)
+        {
+            w->Tw.emplace_back();
+            element_init_G1(w->Tw.back().T, w->pairing);
+        }
+        while(w->te.size() < k)
+        {
+            w->te.emplace_back();
+        }
+        w->matches.resize(k);
+        for(size_t t = 0; t < k; t++)
+        {
+            element_from_bytes(w->Tw[t].T, (unsigned char *)trapdoor_bytes[t]);
+            test_engine_init(w->te[t], w->Tw[t], w->pairing);
+            w->matches[t].clear();
+        }
+        w->queue.clear();
+    }
+    
+    //shards are dealt out in contiguous runs so that each worker starts on its own part of the store
+    size_t shards = (S.count + SEARCH_SHARD - 1) / SEARCH_SHARD;
+    for(size_t j = 0; j < shards; j++)
+    {
+        search_shard shard;
+        shard.begin = j * SEARCH_SHARD;
+        shard.end = min(S.count, shard.begin + SEARCH_SHARD);
+        ex.workers[j * n / shards]->queue.push_front(shard);
+    }
+    
+    vector<thread> pool;
+    for(size_t i = 1; i < n; i++)
+    {
+        pool.push_back(thread(executor_worker, ref(ex), i, cref(S), k));
+    }
+    executor_worker(ex, 0, S, k);
+    for(size_t i = 0; i < pool.size(); i++)
+    {
+        pool[i].join();
+    }
+    
+    size_t total = 0;
+    matches.resize(k);
+    for(size_t t = 0; t < k; t++)
+    {
+        size_t found = matches[t].size();
+        for(size_t i = 0; i < n; i++)
+        {
+            search_worker *w = ex.workers[i].get();
+            matches[t].insert(matches[t].end(), w->matches[t].begin(), w->matches[t].end());
+            test_engine_clear(w->te[t]);
+        }
+        sort(matches[t].begin() + found, matches[t].end());
+        total += matches[t].size() - found;
+    }
+    return total;
+}
+
+//function to search the ciphertexts of a view for one serialized trapdoor on all workers, returns the number of matches
+size_t executor_search(search_executor &ex, const unsigned char *trapdoor_bytes, const ciphertext_view &S, vector<size_t> &matches)
+{
+    vector<vector<size_t>> found(1);
+    found[0].swap(matches);
+    size_t n = executor_search_batch(ex, &trapdoor_bytes, 1, S, found);
+    matches.swap(found[0]);
+    return n;
+}
+
+/*
+	function for the data user to check the matches of trapdoor Tw reported by a search of view S, matches are indices into S.
+	A full V is checked for all matches at once with Test_verify, a digest of V only match by match with Test_stored.
+	The positions in matches of the ones that do not verify are appended to bad, returns true if there are none.
+*/
+bool view_verify(pairing_t pairing, trapdoor &Tw, const ciphertext_view &S, const vector<size_t> &matches, vector<size_t> &bad)
+{
+    size_t before = bad.size();
+    if(S.digest_v)
+    {
+        test_engine te;
+        test_engine_init(te, Tw, pairing);
+        element_t U;
+        element_init_G2(U, pairing);
+        for(size_t i = 0; i < matches.size(); i++)
+        {
+            view_get_U(U, S, matches[i]);
+            if(!Test_stored(te, U, S.V + matches[i] * S.v_stride, true))
+            {
+                bad.push_back(i);
+            }
+        }
+        element_clear(U);
+        test_engine_clear(te);
+        return bad.size() == before;
+    }
+    
+    vector<ciphertext> found(matches.size());
+    vector<element_ptr> T(matches.size(), Tw.T);
+    for(size_t i = 0; i < matches.size(); i++)
+    {
+        ciphertext_init(found[i], pairing);
+        ciphertext_from_view(found[i], S, matches[i]);
+    }
+    Test_verify(pairing, T.data(), found.data(), found.size(), bad);
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        ciphertext_clear(found[i]);
+    }
+    return bad.size() == before;
+}
+
+//=========================================scheme state starts here=================================================================
+
+//function to append a 32 bit length in little endian order to a buffer
+void put_u32(vector<unsigned char> &out, uint32_t v)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        out.push_back((unsigned char)(v >> (8 * i)));
+    }
+}
+
+//function to append a 64 bit value in little endian order to a buffer
+void put_u64(vector<unsigned char> &out, uint64_t v)
+{
+    for(int i = 0; i < 8; i++)
+    {
+        out.push_back((unsigned char)(v >> (8 * i)));
+    }
+}
+
+//function to read a 64 bit little endian value
+uint64_t get_u64(const unsigned char *in)
+{
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; i--)
+    {
+        v = v << 8 | in[i];
+    }
+    return v;
+}
+
+//function to read a 32 bit little endian value
+uint32_t get_u32(const unsigned char *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+//function to store a 32 bit value in little endian order at out
+void set_u32(unsigned char *out, uint32_t v)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        out[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+//function to store a 64 bit value in little endian order at out
+void set_u64(unsigned char *out, uint64_t v)
+{
+    for(int i = 0; i < 8; i++)
+    {
+        out[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+//function to append a length-prefixed blob to a buffer
+void put_blob(vector<unsigned char> &out, const void *data, size_t len)
+{
+    put_u32(out, (uint32_t)len);
+    out.insert(out.end(), (const unsigned char *)data, (const unsigned char *)data + len);
+}
+
+//function to append an element as a length-prefixed blob
+void put_element(vector<unsigned char> &out, element_t e)
+{
+    vector<unsigned char> bytes(element_length_in_bytes(e));
+    element_to_bytes(bytes.data(), e);
+    put_blob(out, bytes.data(), bytes.size());
+}
+
+//function to append an mpz as a length-prefixed big endian blob
+void put_mpz(vector<unsigned char> &out, mpz_t z)
+{
+    vector<unsigned char> bytes((mpz_sizeinbase(z, 2) + 7) / 8);
+    size_t len = 0;
+    mpz_export(bytes.data(), &len, 1, 1, 1, 0, z);
+    put_blob(out, bytes.data(), len);
+}
+
+//function to read the next length-prefixed blob of [pos, end), returns false if it is truncated
+bool get_blob(const unsigned char *&pos, const unsigned char *end, const unsigned char *&data, size_t &len)
+{
+    if(end - pos < 4)
+    {
+        return false;
+    }
+    len = get_u32(pos);
+    if((size_t)(end - pos - 4) < len)
+    {
+        return false;
+    }
+    data = pos + 4;
+    pos += 4 + len;
+    return true;
+}
+
+//function to read a length-prefixed element, e must be initialized in the right group
+bool get_element(const unsigned char *&pos, const unsigned char *end, element_t e)
+{
+    const unsigned char *data;
+    size_t len;
+    if(!get_blob(pos, end, data, len) || len != (size_t)element_length_in_bytes(e))
+    {
+        return false;
+    }
+    element_from_bytes(e, (unsigned char *)data);
+    return true;
+}
+
+//function to read a length-prefixed mpz, z must be initialized
+bool get_mpz(const unsigned char *&pos, const unsigned char *end, mpz_t z)
+{
+    const unsigned char *data;
+    size_t len;
+    if(!get_blob(pos, end, data, len))
+    {
+        return false;
+    }
+    mpz_import(z, len, 1, 1, 1, 0, data);
+    return true;
+}
+
+# define STATE_MAGIC "SPEST001"	//magic of the scheme state file
+# define PUBLIC_MAGIC "SPEPK001"	//magic of the exported public parameters and keys
+
+//function to serialize the scheme state: pairing parameters, P, both key pairs and, on an asymmetric pairing, Q
+void state_to_bytes(setup_result &Para, keys &K, vector<unsigned char> &out)
+{
+    out.assign(STATE_MAGIC, STATE_MAGIC + 8);
+    string params = param_to_string(Para.par);
+    put_blob(out, params.data(), params.length());
+    put_element(out, Para.P);
+    put_mpz(out, K.SKu);
+    put_mpz(out, K.SKs);
+    put_element(out, K.PKu);
+    put_element(out, K.PKs);
+    if(!pairing_is_symmetric(Para.pairing))
+    {
+        put_element(out, Para.Q);
+    }
+}
+
+//function to serialize the public part of the scheme state: pairing parameters, P, PKu, PKs and, on an asymmetric pairing, Q
+void public_to_bytes(setup_result &Para, keys &K, vector<unsigned char> &out)
+{
+    out.assign(PUBLIC_MAGIC, PUBLIC_MAGIC + 8);
+    string params = param_to_string(Para.par);
+    put_blob(out, params.data(), params.length());
+    put_element(out, Para.P);
+    put_element(out, K.PKu);
+    put_element(out, K.PKs);
+    if(!pairing_is_symmetric(Para.pairing))
+    {
+        put_element(out, Para.Q);
+    }
+}
+
+//function to save the scheme state (pairing parameters, P and both key pairs) so another process can load it, returns false on failure
+bool state_save(setup_result &Para, keys &K, const string &path)
+{
+    vector<unsigned char> out;
+    state_to_bytes(Para, K, out);
+    
+    //the state holds secret keys, it is only readable by its owner
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0)
+    {
+        return false;
+    }
+    bool written = write(fd, out.data(), out.size()) == (ssize_t)out.size();
+    return (close(fd) == 0) && written;
+}
+
+//function to load a scheme state saved by state_save into Para and K, which must be empty, returns false on failure and leaves them empty
+bool state_load(setup_result &Para, keys &K, const string &path)
+{
+    ifstream in(path.c_str(), ios::binary);
+    vector<unsigned char> buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if(buf.size() < 8 || memcmp(buf.data(), STATE_MAGIC, 8) != 0)
+    {
+        return false;
+    }
+    const unsigned char *pos = buf.data() + 8, *end = buf.data() + buf.size();
+    
+    const unsigned char *params;
+    size_t len;
+    if(!get_blob(pos, end, params, len) || pbc_param_init_set_buf(Para.par, (const char *)params, len) != 0)
+    {
+        return false;
+    }
+    Para.initialized |= SETUP_PARAM;
+    setup_pairing(Para);
+    
+    element_init_G1(Para.P, Para.pairing);
+    element_init_G2(Para.Q, Para.pairing);
+    element_init_G2(K.PKu, Para.pairing);
+    element_init_G1(K.PKs, Para.pairing);
+    mpz_init(K.SKu);
+    mpz_init(K.SKs);
+    bool valid = get_element(pos, end, Para.P) && get_mpz(pos, end, K.SKu) && get_mpz(pos, end, K.SKs)
+        && get_element(pos, end, K.PKu) && get_element(pos, end, K.PKs);
+    //a state of a symmetric pairing has no Q
+    if(valid && pairing_is_symmetric(Para.pairing))
+    {
+        element_set(Para.Q, Para.P);
+    }
+    else if(valid)
+    {
+        valid = get_element(pos, end, Para.Q);
+    }
+    if(!valid)
+    {
+        element_clear(Para.P);
+        element_clear(Para.Q);
+        element_clear(K.PKu);
+        element_clear(K.PKs);
+        mpz_clear(K.SKu);
+        mpz_clear(K.SKs);
+        setup_clear(Para);
+        return false;
+    }
+    
+    setup_precompute(Para);
+    keys_precompute(K);
+    K.initialized = 1;
+    //parameters that do not give a bilinear map are rejected before anything is encrypted with them
+    if(!pairing_self_test(Para))
+    {
+        keys_clear(K);
+        setup_clear(Para);
+        return false;
+    }
+    return true;
+}
+
+//function to get the lower case hex form of len bytes
+string hex_string(const unsigned char *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    string s(2 * len, '0');
+    for(size_t i = 0; i < len; i++)
+    {
+        s[2 * i] = digits[data[i] >> 4];
+        s[2 * i + 1] = digits[data[i] & 15];
+    }
+    return s;
+}
+
+//function to decode a hex string into bytes, returns false if it is not hex
+bool hex_decode(string_view hex, vector<unsigned char> &out)
+{
+    if(hex.length() % 2 != 0)
+    {
+        return false;
+    }
+    out.resize(hex.length() / 2);
+    for(size_t i = 0; i < hex.length(); i++)
+    {
+        char c = hex[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if(v < 0)
+        {
+            return false;
+        }
+        out[i / 2] = (i % 2 == 0) ? v << 4 : out[i / 2] | v;
+    }
+    return true;
+}
+
+//function to get the hex form of the bytes of an element
+string element_hex(element_t e)
+{
+    vector<unsigned char> bytes(element_length_in_bytes(e));
+    element_to_bytes(bytes.data(), e);
+    return hex_string(bytes.data(), bytes.size());
+}
+
+//function to get the big endian hex form of a non-negative mpz
+string mpz_hex(mpz_t z)
+{
+    vector<unsigned char> bytes((mpz_sizeinbase(z, 2) + 7) / 8);
+    size_t len = 0;
+    mpz_export(bytes.data(), &len, 1, 1, 1, 0, z);
+    return hex_string(bytes.data(), len);
+}
+
+//function to quote a string for JSON
+string json_quote(const string &s)
+{
+    string out = "\"";
+    for(size_t i = 0; i < s.length(); i++)
+    {
+        unsigned char c = s[i];
+        if(c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if(c == '\n')
+        {
+            out += "\\n";
+        }
+        else if(c < 0x20)
+        {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+//function to write the parameters and keys of the scheme as one JSON object, elements as the hex of their bytes, the secret keys only if secrets is true
+void export_json(FILE *out, setup_result &Para, keys &K, bool secrets)
+{
+    fprintf(out, "{\"params\":%s,\"q\":\"%s\",\"P\":\"%s\",\"Q\":\"%s\",\"PKu\":\"%s\",\"PKs\":\"%s\"", json_quote(param_to_string(Para.par)).c_str(),
+        mpz_hex(Para.q).c_str(), element_hex(Para.P).c_str(), element_hex(Para.Q).c_str(), element_hex(K.PKu).c_str(), element_hex(K.PKs).c_str());
+    if(secrets)
+    {
+        fprintf(out, ",\"SKu\":\"%s\",\"SKs\":\"%s\"", mpz_hex(K.SKu).c_str(), mpz_hex(K.SKs).c_str());
+    }
+    fprintf(out, "}\n");
+}
+
+//=========================================scheme state ends here=================================================================
+
+//=========================================ingestion pipeline starts here=================================================================
+
+//function to create a batch queue holding at most capacity batches
+void queue_init(batch_queue &Q, size_t capacity)
+{
+    Q.capacity = capacity;
+    Q.closed = false;
+}
+
+//function to push a batch, blocks while the queue is full
+void queue_push(batch_queue &Q, ingest_batch *b)
+{
+    unique_lock<mutex> guard(Q.lock);
+    Q.changed.wait(guard, [&]{ return Q.items.size() < Q.capacity; });
+    Q.items.push_back(b);
+    Q.changed.notify_all();
+}
+
+//function to pop a batch, blocks while the queue is empty, returns NULL once it is closed and drained
+ingest_batch *queue_pop(batch_queue &Q)
+{
+    unique_lock<mutex> guard(Q.lock);
+    Q.changed.wait(guard, [&]{ return !Q.items.empty() || Q.closed; });
+    if(Q.items.empty())
+    {
+        return NULL;
+    }
+    ingest_batch *b = Q.items.front();
+    Q.items.pop_front();
+    Q.changed.notify_all();
+    return b;
+}
+
+//function to tell the consumer of a queue that no more batches follow
+void queue_close(batch_queue &Q)
+{
+    lock_guard<mutex> guard(Q.lock);
+    Q.closed = true;
+    Q.changed.notify_all();
+}
+
+//function to empty a batch so it can be reused, its buffers keep their capacity
+void batch_reset(ingest_batch &b)
+{
+    b.ids.clear();
+    b.words.bytes.clear();
+    b.words.offset.assign(1, 0);
+    b.first.assign(1, 0);
+    b.out.clear();
+}
+
+//function to parse a JSON string starting at the quote s[pos], pos is moved past it, returns false if it is malformed
+bool json_string(const string &s, size_t &pos, string &out)
+{
+    out.clear();
+    if(pos >= s.length() || s[pos] != '"')
+    {
+        return false;
+    }
+    for(pos++; pos < s.length(); pos++)
+    {
+        char c = s[pos];
+        if(c == '"')
+        {
+            pos++;
+            return true;
+        }
+        if(c != '\\')
+        {
+            out += c;
+            continue;
+        }
+        if(++pos >= s.length())
+        {
+            return false;
+        }
+        switch(s[pos])
+        {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+            {
+                //\uXXXX is written as UTF-8, surrogate pairs are not combined
+                if(pos + 4 >= s.length())
+                {
+                    return false;
+                }
+                unsigned long cp = strtoul(s.substr(pos + 1, 4).c_str(), NULL, 16);
+                pos += 4;
+                if(cp < 0x80)
+                {
+                    out += (char)cp;
+                }
+                else if(cp < 0x800)
+                {
+                    out += (char)(0xC0 | (cp >> 6));
+                    out += (char)(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += (char)(0xE0 | (cp >> 12));
+                    out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                    out += (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default: out += s[pos];
+        }
+    }
+    return false;
+}
+
+//function to skip JSON whitespace
+void json_space(const string &s, size_t &pos)
+{
+    while(pos < s.length() && keyword_space(s[pos]))
+    {
+        pos++;
+    }
+}
+
+//function to parse a JSONL record {"id": "...", "keywords": ["...", ...]}, unknown members must be strings or numbers, a record without keywords is malformed
+bool parse_json_record(const string &line, string &id, vector<string> &words)
+{
+    size_t pos = 0;
+    string key, value;
+    json_space(line, pos);
+    if(pos >= line.length() || line[pos++] != '{')
+    {
+        return false;
+    }
+    for(;;)
+    {
+        json_space(line, pos);
+        if(pos < line.length() && line[pos] == '}')
+        {
+            return !id.empty() && !words.empty();
+        }
+        if(!json_string(line, pos, key))
+        {
+            return false;
+        }
+        json_space(line, pos);
+        if(pos >= line.length() || line[pos++] != ':')
+        {
+            return false;
+        }
+        json_space(line, pos);
+        if(pos >= line.length())
+        {
+            return false;
+        }
+        
+        if(line[pos] == '[')
+        {
+            //array of strings, only "keywords" is kept
+            for(pos++;;)
+            {
+                json_space(line, pos);
+                if(pos < line.length() && line[pos] == ']')
+                {
+                    pos++;
+                    break;
+                }
+                if(!json_string(line, pos, value))
+                {
+                    return false;
+                }
+                //keywords are trimmed and empty ones skipped, as in the tab separated form
+                string_view w = keyword_trim(value);
+                if(key == "keywords" && !w.empty())
+                {
+                    words.push_back(string(w));
+                }
+                json_space(line, pos);
+                if(pos < line.length() && line[pos] == ',')
+                {
+                    pos++;
+                }
+            }
+        }
+        else if(line[pos] == '"')
+        {
+            if(!json_string(line, pos, value))
+            {
+                return false;
+            }
+            if(key == "id")
+            {
+                id = value;
+            }
+        }
+        else
+        {
+            //number or literal, a numeric id is kept as written
+            size_t begin = pos;
+            while(pos < line.length() && line[pos] != ',' && line[pos] != '}' && !keyword_space(line[pos]))
+            {
+                pos++;
+            }
+            if(key == "id")
+            {
+                id = line.substr(begin, pos - begin);
+            }
+        }
+        
+        json_space(line, pos);
+        if(pos < line.length() && line[pos] == ',')
+        {
+            pos++;
+        }
+    }
+}
+
+/*
+	function to parse one input record: JSONL when the line starts with '{', otherwise "<id><TAB><keyword>,<keyword>,...", returns false if it is malformed.
+	Keywords are trimmed and empty ones skipped, a record left without keywords is malformed.
+*/
+bool parse_record(const string &line, string &id, vector<string> &words)
+{
+    id.clear();
+    words.clear();
+    size_t start = line.find_first_not_of(" \t\r");
+    if(start != string::npos && line[start] == '{')
+    {
+        return parse_json_record(line, id, words);
+    }
+    
+    size_t tab = line.find('\t');
+    if(tab == string::npos || tab == 0)
+    {
+        return false;
+    }
+    id = line.substr(0, tab);
+    for(size_t pos = tab + 1; pos <= line.length();)
+    {
+        size_t comma = line.find(',', pos);
+        if(comma == string::npos)
+        {
+            comma = line.length();
+        }
+        string_view w = keyword_trim(string_view(line).substr(pos, comma - pos));
+        if(!w.empty())
+        {
+            words.push_back(string(w));
+        }
+        pos = comma + 1;
+    }
+    return !words.empty();
+}
+
+//read stage: fills batches from the input until it ends or a later stage fails, counts the documents read and the malformed lines
+void ingest_read(istream &in, batch_queue &free_q, batch_queue &hash_q, size_t &documents, size_t &bad, atomic<bool> &failed)
+{
+    string line, id;
+    vector<string> words;
+    ingest_batch *b = queue_pop(free_q);
+    batch_reset(*b);
+    
+    while(!failed.load(memory_order_relaxed) && getline(in, line))
+    {
+        if(line.empty() || line == "\r")
+        {
+            continue;
+        }
+        if(!parse_record(line, id, words))
+        {
+            bad++;
+            continue;
+        }
+        b->ids.push_back(id);
+        keywords_encode(words, b->words);
+        b->first.push_back(keywords_count(b->words));
+        documents++;
+        
+        if(b->ids.size() >= INGEST_BATCH_DOCS || keywords_count(b->words) >= INGEST_BATCH_WORDS)
+        {
+            queue_push(hash_q, b);
+            b = queue_pop(free_q);
+            batch_reset(*b);
+        }
+    }
+    if(!b->ids.empty())
+    {
+        queue_push(hash_q, b);
+    }
+    else
+    {
+        queue_push(free_q, b);
+    }
+    queue_close(hash_q);
+}
+
+//hash stage: computes h2 and, with tag_bits > 0, the tag of every keyword of a batch; once the pipeline has failed batches only pass through
+void ingest_hash(setup_result &Para, const unsigned char *tag_key, int tag_bits, batch_queue &hash_q, batch_queue &encrypt_q, atomic<bool> &failed)
+{
+    unsigned char digest[SHA256_LEN];
+    ingest_batch *b;
+    while((b = queue_pop(hash_q)) != NULL)
+    {
+        size_t n = keywords_count(b->words);
+        if(!failed.load(memory_order_relaxed) && b->h2_size < n)
+        {
+            //the table of a batch only grows, a reused batch allocates nothing here
+            mpz_t *grown = (mpz_t *)realloc(b->h2, n * sizeof(mpz_t));
+            if(grown == NULL)
+            {
+                //the old table stays with the batch and is cleared with it
+                failed.store(true);
+            }
+            else
+            {
+                b->h2 = grown;
+                for(size_t i = b->h2_size; i < n; i++)
+                {
+                    mpz_init(b->h2[i]);
+                }
+                b->h2_size = n;
+            }
+        }
+        if(failed.load(memory_order_relaxed))
+        {
+            queue_push(encrypt_q, b);
+            continue;
+        }
+        b->tag.resize(tag_bits > 0 ? n : 0);
+        for(size_t i = 0; i < n; i++)
+        {
+            STAT_SCOPE(STAT_HASH2);
+            //h2 and the tag both come from the digest of the canonical keyword
+            string_view w = keyword_at(b->words, i);
+            sha256(w.data(), w.length(), digest);
+            digest_to_Zq(digest, Para.q, b->h2[i]);
+            if(tag_bits > 0)
+            {
+                b->tag[i] = keyword_tag(tag_key, digest, tag_bits);
+            }
+        }
+        queue_push(encrypt_q, b);
+    }
+    queue_close(encrypt_q);
+}
+
+/*
+	encryption stage: runs SPE_PP on every keyword and serializes the documents of a batch, every ciphertext is followed by its tag when tags are on.
+	Once the pipeline has failed batches only pass through.
+*/
+void ingest_encrypt(setup_result &Para, keys &K, batch_queue &encrypt_q, batch_queue &write_q, size_t &ciphertexts, atomic<bool> &failed)
+{
+    size_t record_len = ciphertext_length(Para.pairing);
+    ciphertext C;
+    ciphertext_init(C, Para.pairing);
+    element_pool pool;
+    pool_init(pool, Para.pairing);
+    
+    ingest_batch *b;
+    while((b = queue_pop(encrypt_q)) != NULL)
+    {
+        Gmp_scope scope;
+        for(size_t d = 0; d < b->ids.size() && !failed.load(memory_order_relaxed); d++)
+        {
+            //document: id length, id, number of ciphertexts, ciphertexts
+            size_t count = b->first[d + 1] - b->first[d];
+            put_blob(b->out, b->ids[d].data(), b->ids[d].length());
+            put_u32(b->out, (uint32_t)count);
+            for(size_t i = b->first[d]; i < b->first[d + 1]; i++)
+            {
+                SPE_PP_hashed(Para, K, b->h2[i], C, pool);
+                b->out.resize(b->out.size() + record_len);
+                ciphertext_to_bytes(&b->out[b->out.size() - record_len], C);
+                if(!b->tag.empty())
+                {
+                    put_u32(b->out, b->tag[i]);
+                }
+            }
+            ciphertexts += count;
+        }
+        pool_reset(pool);
+        queue_push(write_q, b);
+    }
+    pool_clear(pool);
+    ciphertext_clear(C);
+    queue_close(write_q);
+}
+
+//write stage: writes the serialized documents and hands the batch back to the read stage, a write error stops the pipeline
+void ingest_write(FILE *out, batch_queue &write_q, batch_queue &free_q, atomic<bool> &failed)
+{
+    ingest_batch *b;
+    while((b = queue_pop(write_q)) != NULL)
+    {
+        if(!failed.load(memory_order_relaxed) && fwrite(b->out.data(), 1, b->out.size(), out) != b->out.size())
+        {
+            failed.store(true);
+        }
+        queue_push(free_q, b);
+    }
+}
+
+/*
+	function to encrypt the (document id, keywords) records of in for the keys K of the scheme Para and write the ciphertext stream to out.
+	With tag_bits > 0 every ciphertext carries a keyword tag of that many bits, so the index can bucket it. Returns the number of documents or -1 on a write
+	or allocation error; the first error stops the reading, so the rest of the input is not encrypted for nothing.
+*/
+long ingest(setup_result &Para, keys &K, istream &in, FILE *out, int tag_bits, size_t &ciphertexts, size_t &bad)
+{
+    //stream header: magic, length of one ciphertext and bits of the tags
+    vector<unsigned char> header(STREAM_MAGIC, STREAM_MAGIC + 8);
+    put_u32(header, (uint32_t)ciphertext_length(Para.pairing));
+    put_u32(header, (uint32_t)tag_bits);
+    if(fwrite(header.data(), 1, header.size(), out) != header.size())
+    {
+        return -1;
+    }
+    
+    //INGEST_DEPTH batches circulate through the stages, so memory does not grow with the input
+    batch_queue free_q, hash_q, encrypt_q, write_q;
+    queue_init(free_q, INGEST_DEPTH);
+    queue_init(hash_q, INGEST_DEPTH);
+    queue_init(encrypt_q, INGEST_DEPTH);
+    queue_init(write_q, INGEST_DEPTH);
+    ingest_batch batches[INGEST_DEPTH];
+    for(int i = 0; i < INGEST_DEPTH; i++)
+    {
+        batches[i].h2 = NULL;
+        batches[i].h2_size = 0;
+        queue_push(free_q, &batches[i]);
+    }
+    
+    size_t documents = 0;
+    atomic<bool> failed(false);
+    ciphertexts = 0;
+    bad = 0;
+    unsigned char tag_key[SHA256_LEN];
+    tag_key_derive(Para, K, tag_key);
+    thread hasher(ingest_hash, ref(Para), (const unsigned char *)tag_key, tag_bits, ref(hash_q), ref(encrypt_q), ref(failed));
+    thread encrypter(ingest_encrypt, ref(Para), ref(K), ref(encrypt_q), ref(write_q), ref(ciphertexts), ref(failed));
+    thread writer(ingest_write, out, ref(write_q), ref(free_q), ref(failed));
+    ingest_read(in, free_q, hash_q, documents, bad, failed);
+    hasher.join();
+    encrypter.join();
+    writer.join();
+    
+    for(int i = 0; i < INGEST_DEPTH; i++)
+    {
+        for(size_t k = 0; k < batches[i].h2_size; k++)
+        {
+            mpz_clear(batches[i].h2[k]);
+        }
+        free(batches[i].h2);
+    }
+    return failed.load() ? -1 : (long)documents;
+}
+
+//=========================================ingestion pipeline ends here=================================================================
+
+//=========================================ciphertext index starts here=================================================================
+
+//function to map a whole file read-only, returns NULL if it cannot be mapped
+unsigned char *map_file(const string &path, size_t &len)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        len = st.st_size;
+        map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return map == MAP_FAILED ? NULL : (unsigned char *)map;
+}
+
+//function to round an offset up to the alignment of the index sections
+uint64_t index_align(uint64_t off)
+{
+    return (off + INDEX_ALIGN - 1) / INDEX_ALIGN * INDEX_ALIGN;
+}
+
+//function to write zero bytes until the file reaches offset off
+bool write_padding(FILE *out, uint64_t &pos, uint64_t off)
+{
+    static const unsigned char zero[INDEX_ALIGN] = {0};
+    while(pos < off)
+    {
+        size_t n = min((uint64_t)INDEX_ALIGN, off - pos);
+        if(fwrite(zero, 1, n, out) != n)
+        {
+            return false;
+        }
+        pos += n;
+    }
+    return true;
+}
+
+/*
+	function to walk the documents of a ciphertext stream written by ingest.
+	visit(id, id_len, ciphertexts, count) is called for every document, the ciphertexts are stride bytes apart.
+	The function returns false if the stream is malformed.
+*/
+template <class Visit>
+bool stream_walk(const unsigned char *map, size_t len, size_t stride, Visit visit)
+{
+    const unsigned char *pos = map + STREAM_HEADER, *end = map + len;
+    while(pos < end)
+    {
+        const unsigned char *id;
+        size_t id_len;
+        if(!get_blob(pos, end, id, id_len) || end - pos < 4)
+        {
+            return false;
+        }
+        size_t count = get_u32(pos);
+        pos += 4;
+        if((size_t)(end - pos) / stride < count)
+        {
+            return false;
+        }
+        visit(id, id_len, pos, count);
+        pos += count * stride;
+    }
+    return true;
+}
+
+/*
+	function to build an index file from a ciphertext stream written by ingest, with the parameters of Para.
+	The stream and the new file are both mapped, so memory use does not depend on their size. When the stream carries keyword
+	tags the ciphertexts are placed bucket by bucket. flags are INDEX_* flags that select the compact encodings of U and V.
+	Returns false on failure.
+*/
+bool index_build(setup_result &Para, const string &stream_path, const string &index_path, uint32_t flags)
+{
+    size_t len;
+    unsigned char *map = map_file(stream_path, len);
+    if(map == NULL)
+    {
+        return false;
+    }
+    size_t u_len = pairing_length_in_bytes_G2(Para.pairing);
+    size_t v_len = pairing_length_in_bytes_GT(Para.pairing);
+    size_t record_len = u_len + v_len;
+    if(len < STREAM_HEADER || memcmp(map, STREAM_MAGIC, 8) != 0 || get_u32(map + 8) != record_len || get_u32(map + 12) > TAG_MAX_BITS)
+    {
+        munmap(map, len);
+        return false;
+    }
+    uint32_t tag_bits = get_u32(map + 12);
+    size_t stride = record_len + (tag_bits > 0 ? 4 : 0);
+    size_t buckets = (size_t)1 << tag_bits;
+    
+    //first pass: sizes of the columns and of the buckets, bucket[t + 1] counts the ciphertexts of tag t
+    uint64_t count = 0, documents = 0, id_bytes = 0;
+    vector<uint64_t> bucket(buckets + 1, 0);
+    bool tags_valid = true;
+    bool valid = stream_walk(map, len, stride, [&](const unsigned char *, size_t id_len, const unsigned char *C, size_t n)
+    {
+        documents++;
+        id_bytes += id_len;
+        count += n;
+        for(size_t i = 0; i < n && tag_bits > 0; i++, C += stride)
+        {
+            uint32_t t = get_u32(C + record_len);
+            tags_valid = tags_valid && t < buckets;
+            bucket[min((size_t)t, buckets - 1) + 1]++;
+        }
+    });
+    if(!valid || !tags_valid || documents > UINT32_MAX)
+    {
+        munmap(map, len);
+        return false;
+    }
+    bucket[1] = tag_bits > 0 ? bucket[1] : count;
+    for(size_t t = 1; t <= buckets; t++)
+    {
+        bucket[t] += bucket[t - 1];
+    }
+    
+    //layout of the sections
+    string params = param_to_string(Para.par);
+    //a digest is only kept when it is shorter than V itself
+    flags &= v_len > V_DIGEST_LEN ? INDEX_COMPRESSED_U | INDEX_COMPACT_V : INDEX_COMPRESSED_U;
+    bool compress = (flags & INDEX_COMPRESSED_U) != 0, compact = (flags & INDEX_COMPACT_V) != 0;
+    size_t stored_u = compress ? pairing_length_in_bytes_compressed_G2(Para.pairing) : u_len;
+    size_t stored_v = compact ? V_DIGEST_LEN : v_len;
+    uint64_t params_off = INDEX_HEADER;
+    uint64_t u_off = index_align(params_off + params.length());
+    uint64_t v_off = index_align(u_off + count * stored_u);
+    uint64_t doc_off = index_align(v_off + count * stored_v);
+    uint64_t id_off = index_align(doc_off + count * 4);
+    uint64_t ids_off = index_align(id_off + (documents + 1) * 8);
+    uint64_t bucket_off = tag_bits > 0 ? index_align(ids_off + id_bytes) : 0;
+    uint64_t total = tag_bits > 0 ? bucket_off + (buckets + 1) * 8 : ids_off + id_bytes;
+    
+    vector<unsigned char> header(INDEX_MAGIC, INDEX_MAGIC + 8);
+    put_u32(header, INDEX_VERSION);
+    put_u32(header, flags);
+    put_u64(header, count);
+    put_u64(header, documents);
+    put_u32(header, (uint32_t)stored_u);
+    put_u32(header, (uint32_t)stored_v);
+    put_u64(header, params_off);
+    put_u64(header, params.length());
+    put_u64(header, u_off);
+    put_u64(header, v_off);
+    put_u64(header, doc_off);
+    put_u64(header, id_off);
+    put_u64(header, ids_off);
+    put_u64(header, total);	//length of the whole file
+    put_u32(header, tag_bits);
+    put_u32(header, 0);
+    put_u64(header, bucket_off);
+    header.resize(INDEX_HEADER, 0);
+    
+    //the new file is sized up front and written through a mapping, the ciphertexts of a bucket land at its cursor
+    string tmp = index_path + "." + to_string(getpid());
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        munmap(map, len);
+        return false;
+    }
+    void *mapped = MAP_FAILED;
+    if(ftruncate(fd, total) == 0)
+    {
+        mapped = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(mapped == MAP_FAILED)
+    {
+        close(fd);
+        remove(tmp.c_str());
+        munmap(map, len);
+        return false;
+    }
+    unsigned char *out = (unsigned char *)mapped;
+    memcpy(out, header.data(), header.size());
+    memcpy(out + params_off, params.data(), params.length());
+    
+    //columns U, V and doc, U is recompressed and V replaced by its digest if asked for, the stream holds V in its canonical encoding
+    element_t U;
+    element_init_G2(U, Para.pairing);
+    vector<uint64_t> cursor(bucket.begin(), bucket.end() - 1);
+    uint32_t d = 0;
+    uint64_t at = 0;
+    set_u64(out + id_off, 0);
+    stream_walk(map, len, stride, [&](const unsigned char *id, size_t id_len, const unsigned char *C, size_t n)
+    {
+        for(size_t i = 0; i < n; i++, C += stride)
+        {
+            uint64_t k = cursor[tag_bits > 0 ? get_u32(C + record_len) : 0]++;
+            if(compress)
+            {
+                element_from_bytes(U, (unsigned char *)C);
+                element_to_bytes_compressed(out + u_off + k * stored_u, U);
+            }
+            else
+            {
+                memcpy(out + u_off + k * stored_u, C, u_len);
+            }
+            if(compact)
+            {
+                unsigned char digest[SHA256_LEN];
+                sha256(C + u_len, v_len, digest);
+                memcpy(out + v_off + k * stored_v, digest, V_DIGEST_LEN);
+            }
+            else
+            {
+                memcpy(out + v_off + k * v_len, C + u_len, v_len);
+            }
+            set_u32(out + doc_off + 4 * k, d);
+        }
+        
+        //offset of the next document id and the id
+        memcpy(out + ids_off + at, id, id_len);
+        at += id_len;
+        d++;
+        set_u64(out + id_off + 8 * (uint64_t)d, at);
+    });
+    element_clear(U);
+    for(size_t t = 0; t <= buckets && tag_bits > 0; t++)
+    {
+        set_u64(out + bucket_off + 8 * t, bucket[t]);
+    }
+    
+    munmap(map, len);
+    bool ok = munmap(mapped, total) == 0;
+    ok = (close(fd) == 0) && ok;
+    if(!ok || rename(tmp.c_str(), index_path.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+//function to unmap an index
+void index_close(ciphertext_index &X)
+{
+    if(X.map != NULL)
+    {
+        munmap(X.map, X.map_len);
+        X.map = NULL;
+    }
+}
+
+//function to check that n entries of size bytes starting at off lie within a file of total bytes, without overflowing
+bool index_section_fits(uint64_t off, uint64_t n, uint64_t size, uint64_t total)
+{
+    return off <= total && (size == 0 || n <= (total - off) / size);
+}
+
+/*
+	function to map an index file, the ciphertexts are used in place without deserializing the file, returns false if it is not a valid index.
+	Every section has to lie within the file, the buckets have to be ranges of the ciphertexts, the document ids ranges of the ids section
+	and every ciphertext has to belong to one of the documents, so that no later read of the index leaves the mapping.
+	The lengths of U and V are checked against a pairing by index_check_pairing.
+*/
+bool index_open(ciphertext_index &X, const string &path)
+{
+    X.map = map_file(path, X.map_len);
+    if(X.map == NULL)
+    {
+        return false;
+    }
+    const unsigned char *h = X.map;
+    if(X.map_len < INDEX_HEADER || memcmp(h, INDEX_MAGIC, 8) != 0 || get_u32(h + 8) < 1 || get_u32(h + 8) > INDEX_VERSION)
+    {
+        index_close(X);
+        return false;
+    }
+    
+    X.version = get_u32(h + 8);
+    X.flags = get_u32(h + 12);
+    uint64_t count = get_u64(h + 16);
+    X.documents = get_u64(h + 24);
+    uint32_t u_len = get_u32(h + 32), v_len = get_u32(h + 36);
+    uint64_t params_off = get_u64(h + 40), params_len = get_u64(h + 48);
+    uint64_t u_off = get_u64(h + 56), v_off = get_u64(h + 64), doc_off = get_u64(h + 72);
+    uint64_t id_off = get_u64(h + 80), ids_off = get_u64(h + 88), total = get_u64(h + 96);
+    //version 1 has no buckets and those header bytes are zero
+    X.tag_bits = get_u32(h + 104);
+    uint64_t bucket_off = get_u64(h + 112);
+    if(total != X.map_len || X.documents > UINT32_MAX || X.tag_bits > TAG_MAX_BITS || u_len == 0 || v_len == 0
+        || !index_section_fits(params_off, params_len, 1, total) || !index_section_fits(u_off, count, u_len, total)
+        || !index_section_fits(v_off, count, v_len, total) || !index_section_fits(doc_off, count, 4, total)
+        || !index_section_fits(id_off, X.documents + 1, 8, total) || ids_off > total
+        || (X.tag_bits > 0 && !index_section_fits(bucket_off, ((uint64_t)1 << X.tag_bits) + 1, 8, total))
+        || ((X.flags & INDEX_COMPACT_V) != 0 && v_len != V_DIGEST_LEN))
+    {
+        index_close(X);
+        return false;
+    }
+    
+    //the buckets are ranges of the ciphertexts in order, the ids ranges of the ids section in order
+    bool valid = true;
+    uint64_t last = 0;
+    for(uint64_t t = 0; X.tag_bits > 0 && t <= ((uint64_t)1 << X.tag_bits) && valid; t++)
+    {
+        uint64_t at = get_u64(X.map + bucket_off + 8 * t);
+        valid = at >= last && at <= count;
+        last = at;
+    }
+    last = 0;
+    for(uint64_t d = 0; d <= X.documents && valid; d++)
+    {
+        uint64_t at = get_u64(X.map + id_off + 8 * d);
+        valid = at >= last && at <= total - ids_off;
+        last = at;
+    }
+    for(uint64_t i = 0; i < count && valid; i++)
+    {
+        valid = get_u32(X.map + doc_off + 4 * i) < X.documents;
+    }
+    if(!valid)
+    {
+        index_close(X);
+        return false;
+    }
+    
+    X.params.assign((const char *)X.map + params_off, params_len);
+    X.view.U = X.map + u_off;
+    X.view.V = X.map + v_off;
+    X.view.u_stride = u_len;
+    X.view.v_stride = v_len;
+    X.view.count = count;
+    X.view.compressed = (X.flags & INDEX_COMPRESSED_U) != 0;
+    X.view.digest_v = (X.flags & INDEX_COMPACT_V) != 0;
+    X.doc = X.map + doc_off;
+    X.id_off = X.map + id_off;
+    X.ids = X.map + ids_off;
+    X.bucket = X.map + bucket_off;
+    
+    //a scan reads every column from front to back, a bucketed search only one range of them
+    madvise(X.map, X.map_len, X.tag_bits > 0 ? MADV_NORMAL : MADV_SEQUENTIAL);
+    return true;
+}
+
+//function to check that the lengths of U and V stored in an index are those of the elements of pairing
+bool index_check_pairing(const ciphertext_index &X, pairing_t pairing)
+{
+    size_t u_len = X.view.compressed ? pairing_length_in_bytes_compressed_G2(pairing) : pairing_length_in_bytes_G2(pairing);
+    size_t v_len = X.view.digest_v ? V_DIGEST_LEN : pairing_length_in_bytes_GT(pairing);
+    return X.view.u_stride == u_len && X.view.v_stride == v_len;
+}
+
+//function to get the range [begin, end) of the ciphertexts of an index a search with keyword tag t has to test
+void index_bucket(const ciphertext_index &X, uint32_t t, size_t &begin, size_t &end)
+{
+    if(X.tag_bits == 0)
+    {
+        begin = 0;
+        end = X.view.count;
+        return;
+    }
+    begin = get_u64(X.bucket + 8 * (uint64_t)t);
+    end = get_u64(X.bucket + 8 * ((uint64_t)t + 1));
+}
+
+//function to get the view of the ciphertexts [begin, end) of a view
+ciphertext_view view_range(const ciphertext_view &S, size_t begin, size_t end)
+{
+    ciphertext_view R = S;
+    R.U = S.U + begin * S.u_stride;
+    R.V = S.V + begin * S.v_stride;
+    R.count = end - begin;
+    return R;
+}
+
+//function to get the number of the document ciphertext i of an index belongs to
+uint32_t index_doc(const ciphertext_index &X, size_t i)
+{
+    return get_u32(X.doc + 4 * i);
+}
+
+//function to get the id of document d of an index
+string index_doc_id(const ciphertext_index &X, uint32_t d)
+{
+    uint64_t begin = get_u64(X.id_off + 8 * (uint64_t)d), end = get_u64(X.id_off + 8 * ((uint64_t)d + 1));
+    return string((const char *)X.ids + begin, end - begin);
+}
+
+//=========================================ciphertext index ends here=================================================================
+
+//function to get the ids of the documents of the matches of a search, matches are indices into the range starting at begin and sorted
+void index_match_ids(const ciphertext_index &X, size_t begin, const vector<size_t> &matches, vector<string> &ids)
+{
+    //a bucket keeps the order of the stream, so the ciphertexts of a document are next to each other
+    long last = -1;
+    for(size_t i = 0; i < matches.size(); i++)
+    {
+        uint32_t d = index_doc(X, begin + matches[i]);
+        if((long)d != last)
+        {
+            ids.push_back(index_doc_id(X, d));
+            last = d;
+        }
+    }
+}
+
+//=========================================key provisioning starts here=================================================================
+
+# define KEYSTORE_MAGIC "SPEKS001"	//magic of the keystore file
+# define KEYSTORE_HEADER 32			//magic, count, length of a secret key, length of a public key and offset of the records
+
+/*
+	struct Keystore is a structure.
+	A keystore holds the key pairs (SKu, PKu = SKu Q) of many data users of one scheme. After the header come the pairing
+	parameters and Q as blobs, then count records of sk_len bytes of SKu, big endian and zero padded, and pk_len bytes of PKu,
+	so key pair i is found without reading the others. Q is P on a symmetric pairing, so those keystores are unchanged.
+*/
+typedef struct Keystore
+{
+    unsigned char *map;		//mapping of the whole file
+    size_t map_len;			//length of the mapping
+    uint64_t count;			//number of key pairs
+    uint32_t sk_len, pk_len;	//length of SKu and of PKu in a record
+    string params;			//pairing parameters
+    const unsigned char *Q;	//generator Q of G2 of the scheme, pk_len bytes
+    const unsigned char *records;
+
+}keystore;
+
+/*
+	function run by every thread of keys_provision: draws SKu for records [first, last) of out and computes PKu with a private fixed-base table of Q.
+	failed is set if params are not valid pairing parameters.
+*/
+void provision_worker(const string &params, const vector<unsigned char> &Q_bytes, unsigned char *out, size_t first, size_t last, size_t sk_len, size_t pk_len, char &failed)
+{
+    //a private pairing, as in the search executor, so that no pairing state is shared between threads
+    pairing_t pairing;
+    if(pairing_init_set_buf(pairing, params.data(), params.length()) != 0)
+    {
+        failed = 1;
+        return;
+    }
+    element_t Q, PK;
+    element_init_G2(Q, pairing);
+    element_init_G2(PK, pairing);
+    element_from_bytes(Q, (unsigned char *)Q_bytes.data());
+    element_pp_t Q_pp;
+    element_pp_init(Q_pp, Q);
+    mpz_t SK;
+    mpz_init(SK);
+    
+    {
+        Gmp_scope scope;
+        for(size_t i = first; i < last; i++)
+        {
+            STAT_SCOPE(STAT_KEYGEN);
+            unsigned char *record = out + i * (sk_len + pk_len);
+            scalar_random(SK, pairing->r);
+            scalar_mul_pp(PK, SK, Q_pp);
+            
+            size_t len = (mpz_sizeinbase(SK, 2) + 7) / 8;
+            memset(record, 0, sk_len - len);
+            mpz_export(record + sk_len - len, NULL, 1, 1, 1, 0, SK);
+            element_to_bytes(record + sk_len, PK);
+        }
+    }
+    
+    mpz_clear(SK);
+    element_pp_clear(Q_pp);
+    element_clear(Q);
+    element_clear(PK);
+    pairing_clear(pairing);
+}
+
+//function to generate count data user key pairs for the scheme Para on all cores and write them as a keystore to path, returns false on failure
+bool keys_provision(setup_result &Para, size_t count, unsigned threads, const string &path)
+{
+    if(threads == 0)
+    {
+        threads = max(1U, thread::hardware_concurrency());
+    }
+    string params = param_to_string(Para.par);
+    size_t sk_len = (mpz_sizeinbase(Para.q, 2) + 7) / 8;
+    size_t pk_len = pairing_length_in_bytes_G2(Para.pairing);
+    vector<unsigned char> Q_bytes(pk_len);
+    element_to_bytes(Q_bytes.data(), Para.Q);
+    
+    vector<unsigned char> out(KEYSTORE_MAGIC, KEYSTORE_MAGIC + 8);
+    put_u64(out, count);
+    put_u32(out, sk_len);
+    put_u32(out, pk_len);
+    put_u64(out, 0);
+    put_blob(out, params.data(), params.length());
+    put_blob(out, Q_bytes.data(), pk_len);
+    size_t records = out.size();
+    set_u64(&out[24], records);
+    out.resize(records + count * (sk_len + pk_len));
+    
+    //every thread fills a contiguous run of records
+    vector<thread> pool;
+    vector<char> failed(threads, 0);
+    for(unsigned t = 0; t < threads; t++)
+    {
+        size_t first = count * t / threads, last = count * (t + 1) / threads;
+        pool.push_back(thread(provision_worker, cref(params), cref(Q_bytes), &out[records], first, last, sk_len, pk_len, ref(failed[t])));
+    }
+    for(size_t t = 0; t < pool.size(); t++)
+    {
+        pool[t].join();
+    }
+    for(unsigned t = 0; t < threads; t++)
+    {
+        if(failed[t])
+        {
+            return false;
+        }
+    }
+    
+    //the keystore holds secret keys, it is only readable by its owner
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0)
+    {
+        return false;
+    }
+    bool written = write(fd, out.data(), out.size()) == (ssize_t)out.size();
+    return (close(fd) == 0) && written;
+}
+
+//function to map a keystore written by keys_provision, returns false if it is missing or malformed
+bool keystore_open(keystore &KS, const string &path)
+{
+    KS.map = map_file(path, KS.map_len);
+    if(KS.map == NULL)
+    {
+        return false;
+    }
+    const unsigned char *pos = KS.map + KEYSTORE_HEADER, *end = KS.map + KS.map_len, *data;
+    size_t len;
+    bool valid = KS.map_len >= KEYSTORE_HEADER && memcmp(KS.map, KEYSTORE_MAGIC, 8) == 0;
+    if(valid)
+    {
+        KS.count = get_u64(KS.map + 8);
+        KS.sk_len = get_u32(KS.map + 16);
+        KS.pk_len = get_u32(KS.map + 20);
+        valid = get_blob(pos, end, data, len);
+    }
+    if(valid)
+    {
+        KS.params.assign((const char *)data, len);
+        valid = get_blob(pos, end, KS.Q, len) && len == KS.pk_len;
+    }
+    uint64_t records = valid ? get_u64(KS.map + 24) : 0;
+    uint64_t record_len = (uint64_t)KS.sk_len + KS.pk_len;
+    if(!valid || records != (uint64_t)(pos - KS.map) || record_len == 0 || (KS.map_len - records) / record_len < KS.count)
+    {
+        munmap(KS.map, KS.map_len);
+        KS.map = NULL;
+        return false;
+    }
+    KS.records = KS.map + records;
+    return true;
+}
+
+//function to unmap a keystore
+void keystore_close(keystore &KS)
+{
+    if(KS.map != NULL)
+    {
+        munmap(KS.map, KS.map_len);
+        KS.map = NULL;
+    }
+}
+
+//function to read key pair i of a keystore into SKu and PKu, PKu must be initialized in G2 of the pairing of the keystore
+void keystore_get(const keystore &KS, size_t i, mpz_t SKu, element_t PKu)
+{
+    const unsigned char *record = KS.records + i * ((size_t)KS.sk_len + KS.pk_len);
+    mpz_import(SKu, KS.sk_len, 1, 1, 1, 0, record);
+    element_from_bytes(PKu, (unsigned char *)record + KS.sk_len);
+}
+
+//=========================================key provisioning ends here=================================================================
+
+//=========================================search server starts here=================================================================
+
+# define SERVE_WINDOW_US 2000	//default time a pass waits after the first query so that queries arriving meanwhile share it
+# define SERVE_MAX_BATCH 64		//most queries answered by one pass over the index
+# define SERVE_LINE_MAX 65536	//longest query line accepted
+# define SERVE_ALL_TAGS 0xffffffffu	//tag of a query without one, it is searched in the whole index
+# define SERVE_CONNECTIONS 64	//clients served at once, each by one thread of a fixed pool; more wait to be accepted
+
+/*
+	struct Search_request is a structure.
+	One query of a client: a serialized trapdoor and the bucket it is searched in, answered by the dispatcher.
+*/
+typedef struct Search_request
+{
+    vector<unsigned char> Tw;	//serialized trapdoor
+    uint32_t tag;				//keyword tag, or SERVE_ALL_TAGS
+    size_t begin;				//first ciphertext of the range that was searched
+    vector<size_t> matches;		//indices into that range of the matches
+    bool done;					//set by the dispatcher once matches is filled
+
+}search_request;
+
+/*
+	struct Search_server is a structure.
+	It keeps the index and the search executor loaded. A fixed pool of connection threads takes the accepted clients
+	and queues their queries, and a single dispatcher answers all queued queries of a bucket with one pass over it,
+	so every ciphertext is read and decoded once for all of them. server_stop ends and joins every thread.
+*/
+typedef struct Search_server
+{
+    ciphertext_index X;
+    search_executor ex;
+    size_t trapdoor_len;	//length of a serialized trapdoor for the pairing of the index
+    unsigned window_us;		//coalescing window
+    
+    mutex lock;						//protects everything below
+    condition_variable arrived;		//a query was queued
+    condition_variable answered;	//a pass has finished
+    deque<search_request *> pending;
+    uint64_t passes, queries;		//passes run and queries answered so far
+    condition_variable accepted;	//a client was accepted, or the server stops
+    condition_variable room;		//a connection thread took a client
+    deque<int> clients;				//accepted clients no connection thread has taken yet
+    set<int> active;				//clients being served
+    bool stopping;					//connection threads finish their client and exit
+    bool dispatch_stop;				//the dispatcher exits once nothing is pending
+    
+    thread dispatcher;
+    vector<thread> connections;
+
+}search_server;
+
+//function to queue a query and wait until the dispatcher has answered it
+void server_submit(search_server &srv, search_request &r)
+{
+    unique_lock<mutex> guard(srv.lock);
+    r.done = false;
+    srv.pending.push_back(&r);
+    srv.arrived.notify_one();
+    srv.answered.wait(guard, [&]{ return r.done; });
+}
+
+//function to get the range of the index searched for a tag
+void server_range(search_server &srv, uint32_t tag, size_t &begin, size_t &end)
+{
+    if(tag == SERVE_ALL_TAGS)
+    {
+        begin = 0;
+        end = srv.X.view.count;
+    }
+    else
+    {
+        index_bucket(srv.X, tag, begin, end);
+    }
+}
+
+//dispatcher thread: waits for a query, lets the window pass and answers everything queued by then, one pass per bucket; returns once stopped
+void server_dispatch(search_server &srv)
+{
+    for(;;)
+    {
+        {
+            unique_lock<mutex> guard(srv.lock);
+            srv.arrived.wait(guard, [&]{ return !srv.pending.empty() || srv.dispatch_stop; });
+            if(srv.pending.empty())
+            {
+                return;
+            }
+        }
+        if(srv.window_us > 0)
+        {
+            this_thread::sleep_for(chrono::microseconds(srv.window_us));
+        }
+        
+        vector<search_request *> batch;
+        {
+            lock_guard<mutex> guard(srv.lock);
+            while(!srv.pending.empty() && batch.size() < SERVE_MAX_BATCH)
+            {
+                batch.push_back(srv.pending.front());
+                srv.pending.pop_front();
+            }
+        }
+        
+        //queries of the same bucket share a pass, without tags the whole batch is one pass
+        stable_sort(batch.begin(), batch.end(), [](search_request *a, search_request *b){ return a->tag < b->tag; });
+        for(size_t first = 0, last; first < batch.size(); first = last)
+        {
+            last = first + 1;
+            while(last < batch.size() && batch[last]->tag == batch[first]->tag)
+            {
+                last++;
+            }
+            size_t begin, end;
+            server_range(srv, batch[first]->tag, begin, end);
+            vector<const unsigned char *> T;
+            vector<vector<size_t>> matches(last - first);
+            for(size_t i = first; i < last; i++)
+            {
+                T.push_back(batch[i]->Tw.data());
+            }
+            executor_search_batch(srv.ex, T.data(), T.size(), view_range(srv.X.view, begin, end), matches);
+            for(size_t i = first; i < last; i++)
+            {
+                batch[i]->begin = begin;
+                batch[i]->matches.swap(matches[i - first]);
+            }
+        }
+        
+        {
+            lock_guard<mutex> guard(srv.lock);
+            for(size_t i = 0; i < batch.size(); i++)
+            {
+                batch[i]->done = true;
+            }
+            srv.passes++;
+            srv.queries += batch.size();
+            if(verbosity >= VERBOSE_ALL)
+            {
+                cerr<<"pass "<<srv.passes<<" answered "<<batch.size()<<" queries, "<<srv.queries<<" in total"<<endl;
+            }
+        }
+        srv.answered.notify_all();
+    }
+}
+
+//function to parse a query line: the trapdoor in hex, then optionally a space and the keyword tag in decimal
+bool server_parse(search_server &srv, const string &line, search_request &r)
+{
+    size_t space = line.find(' ');
+    if(!hex_decode(string_view(line).substr(0, space), r.Tw) || r.Tw.size() != srv.trapdoor_len)
+    {
+        return false;
+    }
+    r.tag = SERVE_ALL_TAGS;
+    if(space != string::npos && srv.X.tag_bits > 0)
+    {
+        char *end;
+        unsigned long tag = strtoul(line.c_str() + space + 1, &end, 10);
+        if(*end != 0 || end == line.c_str() + space + 1 || tag >= (1UL << srv.X.tag_bits))
+        {
+            return false;
+        }
+        r.tag = tag;
+    }
+    return true;
+}
+
+//function to write a whole buffer to a socket, returns false if the client is gone
+bool send_all(int fd, const string &data)
+{
+    size_t sent = 0;
+    while(sent < data.length())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+        if(n <= 0)
+        {
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+//function to read the next line of a socket into line, buf keeps what was read beyond it; returns false at the end of the stream
+bool recv_line(int fd, string &buf, string &line)
+{
+    size_t eol;
+    char chunk[4096];
+    while((eol = buf.find('\n')) == string::npos)
+    {
+        if(buf.length() > SERVE_LINE_MAX)
+        {
+            return false;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        buf.append(chunk, n);
+    }
+    line = buf.substr(0, eol);
+    buf.erase(0, eol + 1);
+    return true;
+}
+
+/*
+	connection thread: answers the queries of one client, one per line. The reply is "ok <n>" followed by the ids of the
+	n matching documents, one per line, or "error <reason>".
+*/
+void server_connection(search_server &srv, int fd)
+{
+    string buf, line;
+    search_request r;
+    while(recv_line(fd, buf, line))
+    {
+        string reply;
+        if(!server_parse(srv, line, r))
+        {
+            reply = "error malformed query\n";
+        }
+        else
+        {
+            server_submit(srv, r);
+            vector<string> ids;
+            index_match_ids(srv.X, r.begin, r.matches, ids);
+            reply = "ok " + to_string(ids.size()) + "\n";
+            for(size_t i = 0; i < ids.size(); i++)
+            {
+                reply += ids[i] + "\n";
+            }
+        }
+        if(!send_all(fd, reply))
+        {
+            break;
+        }
+    }
+    close(fd);
+}
+
+//connection thread of the pool: serves the accepted clients one after the other until the server stops
+void server_connections(search_server &srv)
+{
+    for(;;)
+    {
+        int fd;
+        {
+            unique_lock<mutex> guard(srv.lock);
+            srv.accepted.wait(guard, [&]{ return !srv.clients.empty() || srv.stopping; });
+            if(srv.stopping)
+            {
+                return;
+            }
+            fd = srv.clients.front();
+            srv.clients.pop_front();
+            srv.active.insert(fd);
+        }
+        srv.room.notify_one();
+        server_connection(srv, fd);
+        lock_guard<mutex> guard(srv.lock);
+        srv.active.erase(fd);
+    }
+}
+
+//function to start the dispatcher and the pool of connection threads of a server
+void server_start(search_server &srv)
+{
+    srv.stopping = srv.dispatch_stop = false;
+    srv.dispatcher = thread(server_dispatch, ref(srv));
+    for(int i = 0; i < SERVE_CONNECTIONS; i++)
+    {
+        srv.connections.push_back(thread(server_connections, ref(srv)));
+    }
+}
+
+/*
+	function to stop a server: the clients being served are shut down, the connection threads and then the dispatcher
+	are joined, and the executor and the index are released. It may be called whether or not the server was started.
+*/
+void server_stop(search_server &srv)
+{
+    {
+        lock_guard<mutex> guard(srv.lock);
+        srv.stopping = true;
+        for(set<int>::iterator it = srv.active.begin(); it != srv.active.end(); ++it)
+        {
+            shutdown(*it, SHUT_RDWR);
+        }
+        for(size_t i = 0; i < srv.clients.size(); i++)
+        {
+            close(srv.clients[i]);
+        }
+        srv.clients.clear();
+    }
+    srv.accepted.notify_all();
+    for(size_t i = 0; i < srv.connections.size(); i++)
+    {
+        srv.connections[i].join();
+    }
+    srv.connections.clear();
+    
+    //no connection thread is left to queue a query, so the dispatcher only answers what is pending
+    {
+        lock_guard<mutex> guard(srv.lock);
+        srv.dispatch_stop = true;
+    }
+    srv.arrived.notify_all();
+    if(srv.dispatcher.joinable())
+    {
+        srv.dispatcher.join();
+    }
+    executor_clear(srv.ex);
+    index_close(srv.X);
+}
+
+//function to fill a Unix socket address, returns false if the path is too long
+bool unix_address(const string &path, sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.length() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memcpy(addr.sun_path, path.data(), path.length());
+    return true;
+}
+
+//function to serve searches of an index on a Unix socket until the process is killed, returns only on an error
+int run_server(const string &index_path, const string &socket_path, unsigned window_us)
+{
+    search_server srv;
+    srv.window_us = window_us;
+    srv.passes = srv.queries = 0;
+    srv.stopping = srv.dispatch_stop = false;
+    if(!index_open(srv.X, index_path))
+    {
+        cerr<<"cannot load index "<<index_path<<endl;
+        return 1;
+    }
+    //the server holds no keys, it only needs the pairing of the index to know the length of a trapdoor
+    pairing_t pairing;
+    if(pairing_init_set_buf(pairing, srv.X.params.data(), srv.X.params.length()) != 0)
+    {
+        cerr<<"index "<<index_path<<" holds no valid pairing parameters"<<endl;
+        index_close(srv.X);
+        return 1;
+    }
+    srv.trapdoor_len = pairing_length_in_bytes_G1(pairing);
+    bool valid = index_check_pairing(srv.X, pairing);
+    pairing_clear(pairing);
+    if(!valid)
+    {
+        cerr<<"index "<<index_path<<" does not match its pairing parameters"<<endl;
+        index_close(srv.X);
+        return 1;
+    }
+    if(!executor_init(srv.ex, srv.X.params, 0))
+    {
+        cerr<<"cannot start the search workers of "<<index_path<<endl;
+        index_close(srv.X);
+        return 1;
+    }
+    
+    //from here on every return goes through server_stop and closes the socket
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool listening = fd >= 0 && unix_address(socket_path, addr);
+    if(!listening)
+    {
+        cerr<<"cannot create socket "<<socket_path<<endl;
+    }
+    else
+    {
+        unlink(socket_path.c_str());
+        listening = bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(fd, SOMAXCONN) == 0;
+        if(!listening)
+        {
+            cerr<<"cannot listen on "<<socket_path<<endl;
+        }
+    }
+    if(listening && verbosity >= VERBOSE_NORMAL)
+    {
+        cerr<<"serving "<<index_path<<" on "<<socket_path<<endl;
+    }
+    
+    if(listening)
+    {
+        server_start(srv);
+    }
+    while(listening)
+    {
+        int client = accept(fd, NULL, NULL);
+        if(client < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            cerr<<"cannot accept on "<<socket_path<<endl;
+            break;
+        }
+        //at most SERVE_CONNECTIONS clients wait for a connection thread, the others stay in the listen backlog
+        unique_lock<mutex> guard(srv.lock);
+        srv.room.wait(guard, [&]{ return srv.clients.size() < SERVE_CONNECTIONS; });
+        srv.clients.push_back(client);
+        guard.unlock();
+        srv.accepted.notify_one();
+    }
+    server_stop(srv);
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+    return 1;
+}
+
+//function to send one query to a search server and print the ids of the matching documents
+int run_query(const string &socket_path, const string &query)
+{
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || !unix_address(socket_path, addr) || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        cerr<<"cannot connect to "<<socket_path<<endl;
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    string buf, line;
+    if(!send_all(fd, query + "\n") || !recv_line(fd, buf, line) || line.compare(0, 3, "ok ") != 0)
+    {
+        cerr<<"query failed: "<<line<<endl;
+        close(fd);
+        return 1;
+    }
+    size_t n = strtoul(line.c_str() + 3, NULL, 10);
+    for(size_t i = 0; i < n && recv_line(fd, buf, line); i++)
+    {
+        cout<<line<<endl;
+    }
+    close(fd);
+    return 0;
+}
+
+//=========================================search server ends here=================================================================
+
+//=========================================benchmark starts here=================================================================
+
+# define BENCH_MAX_SAMPLES 1000000	//upper bound on the samples of one operation
+# define BENCH_SCALARS 64			//number of random scalars cycled through by the scalar multiplication benchmarks
+
+//function to get the current time in nanoseconds of a monotonic clock
+uint64_t bench_now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//function to print one result line of the benchmark as JSON, samples are sorted in place
+void bench_report(const curve_spec &c, const char *op, vector<uint64_t> &samples)
+{
+    sort(samples.begin(), samples.end());
+    double total = 0;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        total += samples[i];
+    }
+    double mean = total / samples.size();
+    size_t n = samples.size();
+    
+    printf("{\"curve\":\"%s\",\"rbits\":%d,\"qbits\":%d,\"op\":\"%s\",\"samples\":%zu,\"ns_per_op\":%.0f,\"ops_per_sec\":%.2f,"
+        "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"min_ns\":%llu,\"max_ns\":%llu}\n",
+        c.type.c_str(), c.rbits, c.qbits, op, n, mean, 1e9 / mean,
+        (unsigned long long)samples[n / 2], (unsigned long long)samples[n * 9 / 10], (unsigned long long)samples[n * 99 / 100],
+        (unsigned long long)samples[0], (unsigned long long)samples[n - 1]);
+    fflush(stdout);
+}
+
+//function to time op until seconds have passed (at least one sample) and report it
+template <class Op>
+void bench_op(const curve_spec &c, const char *op, double seconds, Op run)
+{
+    vector<uint64_t> samples;
+    run();	//warm up caches and lazily initialized scratch state
+    uint64_t start = bench_now(), limit = (uint64_t)(seconds * 1e9);
+    do
+    {
+        uint64_t t0 = bench_now();
+        run();
+        samples.push_back(bench_now() - t0);
+    }while(bench_now() - start < limit && samples.size() < BENCH_MAX_SAMPLES);
+    bench_report(c, op, samples);
+}
+
+//function to benchmark every primitive of the scheme on one sweep point, returns false if its parameters cannot be generated
+bool bench_curve_run(const curve_spec &c, double seconds)
+{
+    SchemeContext ctx;
+    KeyPair kp;
+    setup_result &Para = *ctx;
+    keys &K = *kp;
+    
+    //parameter generation is far too slow to repeat, it is timed once; nothing is cached so the time is that of a cold start on all cores
+    vector<uint64_t> once(1);
+    uint64_t t0 = bench_now();
+    if(!param_gen(Para.par, c))
+    {
+        return false;
+    }
+    Para.initialized |= SETUP_PARAM;
+    once[0] = bench_now() - t0;
+    bench_report(c, "paramgen", once);
+    
+    bench_op(c, "setup", seconds, [&]
+    {
+        setup_pairing(Para);
+        setup_generators(Para);
+        setup_release_pairing(Para);
+    });
+    setup_pairing(Para);
+    setup_generators(Para);
+    
+    bench_op(c, "keygen", seconds, [&]
+    {
+        keys_generate(Para, K);
+        keys_clear(K);
+    });
+    keys_generate(Para, K);
+    
+    //random scalars and points used as inputs, R2 is the second argument of the pairings
+    mpz_t k[BENCH_SCALARS];
+    element_t zr, R, R2, gt, out;
+    element_init_Zr(zr, Para.pairing);
+    element_init_G1(R, Para.pairing);
+    element_init_G2(R2, Para.pairing);
+    element_init_G1(out, Para.pairing);
+    element_init_GT(gt, Para.pairing);
+    for(int i = 0; i < BENCH_SCALARS; i++)
+    {
+        element_random(zr);
+        mpz_init(k[i]);
+        element_to_mpz(k[i], zr);
+    }
+    element_random(R);
+    element_random(R2);
+    size_t next = 0;
+    mpz_t h;
+    mpz_init(h);
+    
+    bench_op(c, "hash1", seconds, [&]{ hash1(Para, R, h); });
+    bench_op(c, "hash2", seconds, [&]{ keyword_hash(Para, "benchmark-keyword", h); });
+    bench_op(c, "mul_mpz", seconds, [&]{ element_mul_mpz(out, R, k[next++ % BENCH_SCALARS]); });
+    bench_op(c, "pp_pow", seconds, [&]{ element_pp_pow(out, k[next++ % BENCH_SCALARS], Para.P_pp); });
+    bench_op(c, "pairing", seconds, [&]{ element_pairing(gt, Para.P, R2); });
+    
+    //eight pairings sharing one final exponentiation, compare with eight times the pairing above
+    element_t in1[8], in2[8];
+    for(int i = 0; i < 8; i++)
+    {
+        element_init_G1(in1[i], Para.pairing);
+        element_init_G2(in2[i], Para.pairing);
+        element_random(in1[i]);
+        element_random(in2[i]);
+    }
+    bench_op(c, "prod_pairing_8", seconds, [&]{ element_prod_pairing(gt, in1, in2, 8); });
+    for(int i = 0; i < 8; i++)
+    {
+        element_clear(in1[i]);
+        element_clear(in2[i]);
+    }
+    
+    pairing_pp_t pp;
+    pairing_pp_init(pp, Para.P, Para.pairing);
+    bench_op(c, "pairing_pp_apply", seconds, [&]{ pairing_pp_apply(gt, R2, pp); });
+    pairing_pp_clear(pp);
+    
+    ciphertext C;
+    ciphertext_init(C, Para.pairing);
+    element_pool pool;
+    pool_init(pool, Para.pairing);
+    bench_op(c, "spe_pp", seconds, [&]{ SPE_PP(Para, K, "benchmark-keyword", C, pool); });
+    
+    trapdoor Tw;
+    bench_op(c, "trapdoor", seconds, [&]
+    {
+        Trapdoor(Para, K, "benchmark-keyword", Tw);
+        element_clear(Tw.T);
+    });
+    
+    //64 trapdoors sharing one inversion, compare with 64 times the trapdoor above
+    string batch_words[64];
+    trapdoor batch_Tw[64];
+    for(int i = 0; i < 64; i++)
+    {
+        batch_words[i] = "benchmark-keyword-" + to_string(i);
+    }
+    bench_op(c, "trapdoor_batch_64", seconds, [&]
+    {
+        Trapdoor_batch(Para, K, batch_words, 64, batch_Tw, pool);
+        for(int i = 0; i < 64; i++)
+        {
+            element_clear(batch_Tw[i].T);
+        }
+    });
+    
+    //a repeated query served by the trapdoor cache
+    trapdoor_cache tc;
+    trapdoor_cache_init(tc, Para, K, TRAPDOOR_CACHE, true);
+    trapdoor_cache_get(tc, "benchmark-keyword");
+    bench_op(c, "trapdoor_cached", seconds, [&]{ trapdoor_cache_get(tc, "benchmark-keyword"); });
+    trapdoor_cache_clear(tc);
+    
+    //C holds the keyword of the trapdoor, so every Test runs to the final comparison
+    Trapdoor(Para, K, "benchmark-keyword", Tw);
+    test_engine te;
+    test_engine_init(te, Tw, Para.pairing);
+    bench_op(c, "test", seconds, [&]{ Test(te, C); });
+    {
+        Gmp_scope scope;
+        bench_op(c, "test_gmp_cache", seconds, [&]{ Test(te, C); });
+    }
+    test_engine_clear(te);
+    element_clear(Tw.T);
+    pool_clear(pool);
+    ciphertext_clear(C);
+    
+    for(int i = 0; i < BENCH_SCALARS; i++)
+    {
+        mpz_clear(k[i]);
+    }
+    mpz_clear(h);
+    element_clear(zr);
+    element_clear(R);
+    element_clear(R2);
+    element_clear(out);
+    element_clear(gt);
+    return true;
+}
+
+//function to run the benchmark: every primitive on every sweep point for about seconds each, one JSON object per line on stdout
+int run_bench(double seconds, vector<string> specs)
+{
+    if(specs.empty())
+    {
+        //the lab parameters and the usual sizes from 80 to 128 bit security, symmetric and asymmetric
+        specs = {"a:11:10", "a:160:512", "a:224:1024", "a:256:1536", "a1:256", "a1:512", "f:160", "f:256"};
+    }
+    for(size_t i = 0; i < specs.size(); i++)
+    {
+        curve_spec c;
+        if(!curve_parse(specs[i], c))
+        {
+            cerr<<"bad curve "<<specs[i]<<", expected a:<rbits>:<qbits>, a1:<bits>, d:<discriminant>:<qbits> or f:<rbits>"<<endl;
+            return 2;
+        }
+        if(!bench_curve_run(c, seconds))
+        {
+            cerr<<"no curve found for "<<specs[i]<<endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//=========================================benchmark ends here=================================================================
+
+//function to run all algorithms of the scheme once on a few keywords
+int run_demo()
+{
+	// security paramater of type mpz
+    mpz_t security_parameter;
+    //Initializing security para,eter
+    mpz_init(security_parameter);
+    mpz_set_ui(security_parameter, 10);      // Setting lambda =6
+    
+    //the scheme and the keys of this run, both are released when the demo returns
+    SchemeContext ctx;
+    KeyPair kp;
+    setup_result &Para = *ctx;
+    keys &K = *kp;
+    
+    //Setup Algorithm
+	bool ready = setup(Para, security_parameter);
+    mpz_clear(security_parameter);
+    if(!ready)
+    {
+        return 1;
+    }
+    
+    //Key Generation Algorithm
+	KeyGen(Para, K);
+    
+    if(verbosity >= VERBOSE_NORMAL)
+    {
+        cout<<endl<<"==============================================================="<<endl;
+        cout<<"SPE_PP, Trapdoor and Test Algorithms"<<endl;
+        cout<<"==============================================================="<<endl<<endl;
+    }
+    
+    //keywords stored by the data sender
+    string words[] = {"cloud", "storage", "privacy", "search", "cloud"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    vector<ciphertext> store(n);
+    element_pool pool;
+    pool_init(pool, Para.pairing);
+    for(size_t i = 0; i < n; i++)
+    {
+        ciphertext_init(store[i], Para.pairing);
+        SPE_PP(Para, K, words[i], store[i], pool);
+    }
+    pool_clear(pool);
+    
+    //data user searches for the keyword "cloud"
+    trapdoor Tw;
+    Trapdoor(Para, K, "cloud", Tw);
+    vector<size_t> matches;
+    Test_search(Tw, store.data(), n, Para.pairing, matches);
+    
+    cout<<"Search for \"cloud\" matched "<<matches.size()<<" of "<<n<<" ciphertexts:";
+    for(size_t i = 0; i < matches.size(); i++)
+    {
+        cout<<" "<<matches[i];
+    }
+    cout<<endl;
+    
+    //the same search on the multi-threaded executor, which only sees the serialized store and trapdoor
+    ciphertext_store S;
+    store_init(S, Para.pairing);
+    for(size_t i = 0; i < n; i++)
+    {
+        store_append(S, store[i]);
+    }
+    vector<unsigned char> Tw_bytes(pairing_length_in_bytes_G1(Para.pairing));
+    element_to_bytes(Tw_bytes.data(), Tw.T);
+    
+    search_executor ex;
+    executor_init(ex, param_to_string(Para.par), 0);
+    vector<size_t> parallel_matches;
+    executor_search(ex, Tw_bytes.data(), store_view(S), parallel_matches);
+    executor_clear(ex);
+    
+    cout<<"Parallel search on "<<thread::hardware_concurrency()<<" cores matched "<<parallel_matches.size()<<" ciphertexts"<<endl;
+    
+    //repeated searches through the trapdoor cache, only the first one computes the trapdoor and e(T, .)
+    trapdoor_cache tc;
+    trapdoor_cache_init(tc, Para, K, TRAPDOOR_CACHE, true);
+    vector<size_t> cached_matches;
+    for(int round = 0; round < 3; round++)
+    {
+        shared_ptr<trapdoor_entry> e = trapdoor_cache_get(tc, round == 1 ? " Cloud" : "cloud");
+        test_engine te;
+        test_engine_init_cached(te, *e, Para.pairing);
+        cached_matches.clear();
+        Test_batch(te, store.data(), n, 0, cached_matches);
+        test_engine_clear(te);
+    }
+    uint64_t hits, misses, evictions;
+    trapdoor_cache_stats(tc, hits, misses, evictions);
+    cout<<"Cached search matched "<<cached_matches.size()<<" ciphertexts, trapdoor cache hits "<<hits<<", misses "<<misses<<endl;
+    trapdoor_cache_clear(tc);
+    
+    element_clear(Tw.T);
+    for(size_t i = 0; i < n; i++)
+    {
+        ciphertext_clear(store[i]);
+    }
+    
 	return 0;
 }
+
+//function to print how the program is used
+void usage()
+{
+    cerr<<"usage: lab2 [-q | -v] [--show-secrets] [mode]  -q prints only results, -v also every public value,"<<endl;
+    cerr<<"                                              secret keys are only printed with --show-secrets"<<endl;
+    cerr<<"       lab2                                   run the scheme once on a few keywords"<<endl;
+    cerr<<"       lab2 init <state> [curve]              run Setup and KeyGen and save the scheme state, on curve or $SPE_CURVE"<<endl;
+    cerr<<"       lab2 export <state> json|bin [secrets]  write the parameters and public keys, and the secret keys if asked, to stdout"<<endl;
+    cerr<<"       lab2 provision <state> <count> <keystore>  generate count data user key pairs on all cores into a keystore"<<endl;
+    cerr<<"       lab2 keystore <state> <keystore> <i>    check key pair i of a keystore and print its public key"<<endl;
+    cerr<<"       lab2 ingest <state> <input|-> <output> [tag bits]  encrypt (document id, keywords) records with SPE_PP,"<<endl;
+    cerr<<"                                              tag bits (0 to "<<TAG_MAX_BITS<<", default 0) bucket the index by a keyed keyword tag"<<endl;
+    cerr<<"       lab2 index <state> <stream> <index> [compress] [compact]  build an index from the output of ingest,"<<endl;
+    cerr<<"                                              compress stores U compressed, compact a "<<V_DIGEST_LEN<<" byte digest of V"<<endl;
+    cerr<<"       lab2 search <state> <index> <keyword>  print the ids of the documents containing keyword"<<endl;
+    cerr<<"       lab2 trapdoor <state> <keyword> [tag bits]  print the trapdoor of keyword in hex, and its tag for an index with tags"<<endl;
+    cerr<<"       lab2 trapdoors <state> <input|-> [tag bits]  the same for every line of input, with one inversion per "<<TRAPDOOR_BATCH<<" keywords"<<endl;
+    cerr<<"       lab2 serve <index> <socket> [window us]  answer queries on a Unix socket, queries arriving within the window"<<endl;
+    cerr<<"                                              (default "<<SERVE_WINDOW_US<<" us) share one pass over the index"<<endl;
+    cerr<<"       lab2 query <socket> <trapdoor> [tag]    print the ids of the documents matching a trapdoor printed by lab2 trapdoor"<<endl;
+    cerr<<"       lab2 params <rbits> <qbits> | <curve>   generate type a or curve parameters into the parameter store ($SPE_PARAM_DIR or .)"<<endl;
+    cerr<<"       lab2 bench [seconds] [curve]...          time every primitive, one JSON line per result"<<endl;
+    cerr<<"       a curve is a:<rbits>:<qbits> or a1:<bits>, symmetric, or d:<discriminant>:<qbits> or f:<rbits>, asymmetric"<<endl;
+}
+
+int main (int argc, char **argv) 
+{
+    gmp_arena_install();
+    stats_init();
+    
+    //options come before the mode and are removed from argv
+    int options = 1;
+    for(; options < argc && argv[options][0] == '-' && argv[options][1] != 0; options++)
+    {
+        if(strcmp(argv[options], "-q") == 0)
+        {
+            verbosity = VERBOSE_QUIET;
+        }
+        else if(strcmp(argv[options], "-v") == 0)
+        {
+            verbosity = VERBOSE_ALL;
+        }
+        else if(strcmp(argv[options], "--show-secrets") == 0)
+        {
+            show_secrets = true;
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    argv[options - 1] = argv[0];
+    argv += options - 1;
+    argc -= options - 1;
+    
+    if(argc == 1)
+    {
+        return run_demo();
+    }
+    
+    SchemeContext ctx;
+    KeyPair kp;
+    setup_result &Para = *ctx;
+    keys &K = *kp;
+    
+    string mode = argv[1];
+    if(mode == "init" && (argc == 3 || argc == 4))
+    {
+        //the curve of the command line or $SPE_CURVE, else the same sizes as the demo, security parameter 10, without printing anything
+        curve_spec curve;
+        if(!(argc == 4 ? curve_parse(argv[3], curve) : curve_select(curve, 11, 10)))
+        {
+            usage();
+            return 2;
+        }
+        if(!setup_generate(Para, curve))
+        {
+            cerr<<"no curve found for "<<(argc == 4 ? argv[3] : "SPE_CURVE")<<endl;
+            return 1;
+        }
+        keys_generate(Para, K);
+        if(!state_save(Para, K, argv[2]))
+        {
+            cerr<<"cannot write state "<<argv[2]<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if(mode == "export" && (argc == 4 || (argc == 5 && strcmp(argv[4], "secrets") == 0)))
+    {
+        string format = argv[3];
+        if(format != "json" && format != "bin")
+        {
+            usage();
+            return 2;
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        bool secrets = argc == 5;
+        if(format == "json")
+        {
+            export_json(stdout, Para, K, secrets);
+        }
+        else
+        {
+            //with the secret keys the binary export is a state file, without them it holds the public part only
+            vector<unsigned char> out;
+            if(secrets)
+            {
+                state_to_bytes(Para, K, out);
+            }
+            else
+            {
+                public_to_bytes(Para, K, out);
+            }
+            fwrite(out.data(), 1, out.size(), stdout);
+        }
+        return fflush(stdout) == 0 ? 0 : 1;
+    }
+    if(mode == "ingest" && (argc == 5 || argc == 6))
+    {
+        int tag_bits = argc == 6 ? atoi(argv[5]) : 0;
+        if(tag_bits < 0 || tag_bits > TAG_MAX_BITS)
+        {
+            usage();
+            return 2;
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        ifstream file;
+        if(strcmp(argv[3], "-") != 0)
+        {
+            file.open(argv[3]);
+            if(!file)
+            {
+                cerr<<"cannot open "<<argv[3]<<endl;
+                return 1;
+            }
+        }
+        FILE *out = fopen(argv[4], "wb");
+        if(out == NULL)
+        {
+            cerr<<"cannot create "<<argv[4]<<endl;
+            return 1;
+        }
+        
+        size_t ciphertexts, bad;
+        long documents = ingest(Para, K, file.is_open() ? (istream &)file : cin, out, tag_bits, ciphertexts, bad);
+        if(fclose(out) != 0 || documents < 0)
+        {
+            cerr<<"cannot write "<<argv[4]<<endl;
+            return 1;
+        }
+        if(verbosity >= VERBOSE_NORMAL)
+        {
+            cerr<<"ingested "<<documents<<" documents, "<<ciphertexts<<" ciphertexts, "<<bad<<" malformed lines skipped"<<endl;
+        }
+        return 0;
+    }
+    if(mode == "params" && (argc == 3 || argc == 4))
+    {
+        //the two argument form is type a
+        curve_spec curve;
+        string spec = argc == 4 ? string("a:") + argv[2] + ":" + argv[3] : string(argv[2]);
+        if(!curve_parse(spec, curve))
+        {
+            usage();
+            return 2;
+        }
+        //workers started later with the same curve load it instead of generating one
+        if(!param_store_get(Para.par, curve))
+        {
+            cerr<<"no curve found for "<<spec<<endl;
+            return 1;
+        }
+        Para.initialized |= SETUP_PARAM;
+        cout<<param_cache_path(curve)<<endl;
+        return 0;
+    }
+    if(mode == "bench")
+    {
+        double seconds = argc >= 3 ? atof(argv[2]) : 1.0;
+        if(seconds <= 0)
+        {
+            usage();
+            return 2;
+        }
+        return run_bench(seconds, vector<string>(argv + min(argc, 3), argv + argc));
+    }
+    if(mode == "index" && argc >= 5 && argc <= 7)
+    {
+        uint32_t flags = 0;
+        for(int i = 5; i < argc; i++)
+        {
+            if(strcmp(argv[i], "compress") == 0)
+            {
+                flags |= INDEX_COMPRESSED_U;
+            }
+            else if(strcmp(argv[i], "compact") == 0)
+            {
+                flags |= INDEX_COMPACT_V;
+            }
+            else
+            {
+                usage();
+                return 2;
+            }
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        if(!index_build(Para, argv[3], argv[4], flags))
+        {
+            cerr<<"cannot build index "<<argv[4]<<" from "<<argv[3]<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if(mode == "provision" && argc == 5)
+    {
+        long long count = atoll(argv[3]);
+        if(count <= 0)
+        {
+            usage();
+            return 2;
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        if(!keys_provision(Para, count, 0, argv[4]))
+        {
+            cerr<<"cannot write keystore "<<argv[4]<<endl;
+            return 1;
+        }
+        return 0;
+    }
+    if(mode == "keystore" && argc == 5)
+    {
+        keystore KS;
+        if(!state_load(Para, K, argv[2]) || !keystore_open(KS, argv[3]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<" or keystore "<<argv[3]<<endl;
+            return 1;
+        }
+        long long i = atoll(argv[4]);
+        if(KS.params != param_to_string(Para.par) || i < 0 || (uint64_t)i >= KS.count)
+        {
+            cerr<<"keystore "<<argv[3]<<" has no key pair "<<argv[4]<<" for this scheme"<<endl;
+            keystore_close(KS);
+            return 1;
+        }
+        mpz_t SKu;
+        element_t PKu, check;
+        mpz_init(SKu);
+        element_init_G2(PKu, Para.pairing);
+        element_init_G2(check, Para.pairing);
+        keystore_get(KS, i, SKu, PKu);
+        element_pp_pow(check, SKu, Para.Q_pp);
+        bool valid = mpz_sgn(SKu) > 0 && mpz_cmp(SKu, Para.q) < 0 && element_cmp(check, PKu) == 0;
+        cout<<"{\"index\":"<<i<<",\"PKu\":\""<<element_hex(PKu)<<"\"";
+        if(show_secrets)
+        {
+            cout<<",\"SKu\":\""<<mpz_hex(SKu)<<"\"";
+        }
+        cout<<",\"valid\":"<<(valid ? "true" : "false")<<"}"<<endl;
+        mpz_clear(SKu);
+        element_clear(PKu);
+        element_clear(check);
+        keystore_close(KS);
+        return valid ? 0 : 1;
+    }
+    if(mode == "trapdoor" && (argc == 4 || argc == 5))
+    {
+        int tag_bits = argc == 5 ? atoi(argv[4]) : 0;
+        if(tag_bits < 0 || tag_bits > TAG_MAX_BITS)
+        {
+            usage();
+            return 2;
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        trapdoor Tw;
+        Trapdoor(Para, K, argv[3], Tw);
+        cout<<element_hex(Tw.T);
+        element_clear(Tw.T);
+        if(tag_bits > 0)
+        {
+            unsigned char tag_key[SHA256_LEN], digest[SHA256_LEN];
+            tag_key_derive(Para, K, tag_key);
+            keyword_digest(argv[3], digest);
+            cout<<" "<<keyword_tag(tag_key, digest, tag_bits);
+        }
+        cout<<endl;
+        return 0;
+    }
+    if(mode == "trapdoors" && (argc == 4 || argc == 5))
+    {
+        int tag_bits = argc == 5 ? atoi(argv[4]) : 0;
+        if(tag_bits < 0 || tag_bits > TAG_MAX_BITS)
+        {
+            usage();
+            return 2;
+        }
+        if(!state_load(Para, K, argv[2]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<endl;
+            return 1;
+        }
+        ifstream file;
+        if(strcmp(argv[3], "-") != 0)
+        {
+            file.open(argv[3]);
+            if(!file)
+            {
+                cerr<<"cannot open "<<argv[3]<<endl;
+                return 1;
+            }
+        }
+        istream &in = file.is_open() ? (istream &)file : cin;
+        unsigned char tag_key[SHA256_LEN], digest[SHA256_LEN];
+        tag_key_derive(Para, K, tag_key);
+        
+        element_pool pool;
+        pool_init(pool, Para.pairing);
+        vector<string> words;
+        trapdoor Tw[TRAPDOOR_BATCH];
+        bool more = true;
+        while(more)
+        {
+            string line;
+            words.clear();
+            while(words.size() < TRAPDOOR_BATCH && (more = (bool)getline(in, line)))
+            {
+                words.push_back(line);
+            }
+            Trapdoor_batch(Para, K, words.data(), words.size(), Tw, pool);
+            for(size_t i = 0; i < words.size(); i++)
+            {
+                cout<<element_hex(Tw[i].T);
+                element_clear(Tw[i].T);
+                if(tag_bits > 0)
+                {
+                    keyword_digest(words[i], digest);
+                    cout<<" "<<keyword_tag(tag_key, digest, tag_bits);
+                }
+                cout<<"\n";
+            }
+        }
+        pool_clear(pool);
+        return fflush(stdout) == 0 && cout.flush() ? 0 : 1;
+    }
+    if(mode == "serve" && (argc == 4 || argc == 5))
+    {
+        return run_server(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : SERVE_WINDOW_US);
+    }
+    if(mode == "query" && (argc == 4 || argc == 5))
+    {
+        return run_query(argv[2], argc == 5 ? string(argv[3]) + " " + argv[4] : string(argv[3]));
+    }
+    if(mode == "search" && argc == 5)
+    {
+        ciphertext_index X;
+        if(!state_load(Para, K, argv[2]) || !index_open(X, argv[3]))
+        {
+            cerr<<"cannot load state "<<argv[2]<<" or index "<<argv[3]<<endl;
+            return 1;
+        }
+        if(X.params != param_to_string(Para.par) || !index_check_pairing(X, Para.pairing))
+        {
+            cerr<<"index "<<argv[3]<<" was built with other pairing parameters"<<endl;
+            index_close(X);
+            return 1;
+        }
+        
+        //the data user computes the trapdoor, the server side only needs the index and the trapdoor bytes
+        trapdoor Tw;
+        Trapdoor(Para, K, argv[4], Tw);
+        vector<unsigned char> Tw_bytes(pairing_length_in_bytes_G1(Para.pairing));
+        element_to_bytes(Tw_bytes.data(), Tw.T);
+        
+        //with keyword tags only the bucket of the keyword can hold a match
+        size_t begin, end;
+        uint32_t tag = 0;
+        if(X.tag_bits > 0)
+        {
+            unsigned char tag_key[SHA256_LEN], digest[SHA256_LEN];
+            tag_key_derive(Para, K, tag_key);
+            keyword_digest(argv[4], digest);
+            tag = keyword_tag(tag_key, digest, X.tag_bits);
+        }
+        index_bucket(X, tag, begin, end);
+        
+        search_executor ex;
+        if(!executor_init(ex, X.params, 0))
+        {
+            cerr<<"cannot start the search workers of "<<argv[3]<<endl;
+            element_clear(Tw.T);
+            index_close(X);
+            return 1;
+        }
+        vector<size_t> matches;
+        executor_search(ex, Tw_bytes.data(), view_range(X.view, begin, end), matches);
+        executor_clear(ex);
+        
+        //the data user checks the matches reported by the server side
+        vector<size_t> bad;
+        if(!view_verify(Para.pairing, Tw, view_range(X.view, begin, end), matches, bad))
+        {
+            cerr<<bad.size()<<" reported matches do not verify and are dropped"<<endl;
+            for(size_t i = bad.size(); i-- > 0;)
+            {
+                matches.erase(matches.begin() + bad[i]);
+            }
+        }
+        element_clear(Tw.T);
+        
+        vector<string> ids;
+        index_match_ids(X, begin, matches, ids);
+        for(size_t i = 0; i < ids.size(); i++)
+        {
+            cout<<ids[i]<<endl;
+        }
+        index_close(X);
+        return 0;
+    }
+    
+    usage();
+    return 2;
+}
 /*
 //converting data to string and storing it in variable message
     string message="";